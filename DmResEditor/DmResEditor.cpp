@@ -17,6 +17,8 @@ using namespace Ctrl;
 #if MUI_CFG_ENABLE_V1DMRES
 
 DMResources dmRes;
+//加载的资源文件路径 保存到该路径时使用追加保存
+std::wstring dmResPath;
 
 XML::MuiXML* m_xmlui = nullptr;
 
@@ -499,7 +501,15 @@ bool MainWindow::EventProc(UINotifyEvent event, UIControl* control, _m_param par
 	else if (MUIEVENT(Event_Mouse_LClick, L"savefile"))
 	{
 		std::wstring path = static_cast<UIEditBox*>(GetRootControl()->Child(L"path"))->GetCurText();
-		if (dmRes.SaveResource(path))
+		bool saved = false;
+#if MUI_CFG_ENABLE_V2DMRES
+		//保存到原文件时只追加修改的资源 原文件不是v2格式时按原格式整理
+		if (path == dmResPath)
+			saved = dmRes.SaveResourceAppend() || dmRes.Compact();
+		else
+#endif
+			saved = dmRes.SaveResource(path);
+		if (saved)
 			MessageBoxW(g_hWnd, L"资源以成功保存到指定路径~", L"保存", MB_ICONINFORMATION);
 		else
 			MessageBoxW(g_hWnd, L"保存文件失败! 文件可能被占用或不存在", L"保存", MB_ICONERROR);
@@ -535,6 +545,7 @@ bool MainWindow::EventProc(UINotifyEvent event, UIControl* control, _m_param par
 			listbox->DeleteAllItem();
 			listbox->SetEnabled(false);
 			dmRes.CloseResource();
+			dmResPath.clear();
 		}
 	}
 	else if (MUIEVENT(Event_Mouse_LClick, L"loaddmres"))
@@ -542,6 +553,7 @@ bool MainWindow::EventProc(UINotifyEvent event, UIControl* control, _m_param par
 		std::wstring path = static_cast<UIEditBox*>(GetRootControl()->Child(L"path"))->GetCurText();
 		if (dmRes.LoadResource(path, true))
 		{
+			dmResPath = path;
 			control->SetEnabled(false);
 			UIListBox* listbox = (UIListBox*)GetRootControl()->Child(L"reslist");
 
@@ -20,10 +20,14 @@
 */
 #pragma once
 #include <Mui_Base.h>
+#include <list>
 
 #if MUI_CFG_ENABLE_V1DMRES
 
 #define DMResVer L"v1.0.1";
+#if MUI_CFG_ENABLE_V2DMRES
+#define DMResVer2 L"v2.0.0"
+#endif
 
 namespace Mui {
 
@@ -38,6 +42,8 @@ namespace Mui {
 		unsigned long blockSize = 0;
 		//文本资源
 		std::wstring resText;
+		//压缩存储 在加密前压缩数据资源 块模式按块压缩以支持随机读取 需要启用MUI_CFG_ENABLE_V2DMRES
+		bool compress = false;
 	};
 
 	//资源类型
@@ -54,8 +60,12 @@ namespace Mui {
 		_m_param param = 0;
 	};
 
+	class DMResStream;
+	using DMResStreamPtr = RAII::Mui_Ptr<DMResStream>;
+
 	//梦月资源类
-	//该类仅作为兼容和迁移旧项目使用 由于性能和安全问题 不建议再使用 请使用新的资源管理类DMResFile V2 需要在编译时定义MUI_CFG_ENABLE_V2DMRES
+	//启用MUI_CFG_ENABLE_V2DMRES时读取同时支持v1和v2格式 保存时默认使用v1格式 v2格式需要在保存时指定
+	//v2格式的资源目录位于文件头部并按名称哈希排序 资源数据按4K对齐 每个资源带有内容哈希
 	class DMResources
 	{
 	public:
@@ -69,6 +79,13 @@ namespace Mui {
 		*/
 		bool LoadResource(std::wstring resfiles, bool mem = false);
 
+		/*以内存映射模式从文件初始化资源 资源仅初始化一次 多次返回false
+		* 加载时只解析资源头和位置 不读取资源数据 读取时直接从映射视图解密
+		* 映射模式为只读模式 不支持写入和修改
+		* @param resfiles dmres文件路径
+		*/
+		bool LoadResourceMapped(std::wstring resfiles);
+
 #ifdef _WIN32
 		//从WindowsPE读取资源
 		static UIResource ReadPEResource(DWORD resID, LPCWSTR type);
@@ -119,6 +136,15 @@ namespace Mui {
 		*/
 		bool ReadResBlockInfo(std::wstring resname, _m_size* blocksize);
 
+		/*打开资源数据流 按需读取和解密 块模式资源按块边界对齐读取
+		* 数据流持有打开时的资源数据 资源被修改 删除或关闭后仍读取打开时的内容
+		* @param resname - 资源名称
+		* @param reskey - 资源秘钥
+		*
+		* @return 资源不存在或文件打开失败返回nullptr
+		*/
+		DMResStreamPtr OpenStream(std::wstring resname, std::wstring reskey);
+
 		//枚举资源名称
 		bool EnumResourceName(std::vector<std::wstring>& nameList);
 		//获取类名
@@ -128,9 +154,9 @@ namespace Mui {
 
 		//新建一个内存资源类 资源仅初始化一次 多次返回false 类名长度不能大于30
 		bool CreateResource(std::wstring classname);
-		//添加一个资源
+		//添加一个资源 资源名已存在时返回false
 		bool AddResource(DMResKey res, std::wstring resname, std::wstring reskey, DMEncBlockCallback callback = DMEncBlockCallback());
-		//重命名一个资源
+		//重命名一个资源 新名称已存在时返回false
 		bool RenameResource(std::wstring resname, std::wstring newname);
 		//重命名资源类名
 		void RenameClassName(std::wstring newname);
@@ -139,8 +165,55 @@ namespace Mui {
 			ResType type = AllRes, DMEncBlockCallback callback = DMEncBlockCallback());
 		//删除一个资源
 		bool DeleteResource(std::wstring resname);
-		//保存资源文件 将所有更改写入文件
-		bool SaveResource(std::wstring filename);
+		/*保存资源文件 将所有更改写入文件 filename为加载的文件时等同于Compact
+		* @param v2 - 写入v2格式 需要启用MUI_CFG_ENABLE_V2DMRES 默认写入v1格式 旧版本只能读取v1格式
+		* v1格式不能记录压缩存储 包含压缩存储的资源时只能写入v2格式 否则返回false
+		*/
+		bool SaveResource(std::wstring filename, bool v2 = false);
+
+		/*整理资源文件 将全部资源按加载的文件格式重新写入 回收追加保存后不再使用的空间 完成后重新加载资源
+		* 仅支持以文件模式或内存模式从文件加载的资源 之前打开的数据流将失效
+		*/
+		bool Compact();
+
+		//计算数据哈希 FNV-1a 64位 与v2格式目录中的内容哈希相同
+		static _m_ulong64 HashData(const _m_byte* data, _m_size size, _m_ulong64 hash = 0xCBF29CE484222325ull);
+
+		/*启用或禁用秘钥派生缓存 默认启用
+		* 禁用后每次读取都重新派生秘钥 输出不变 用于性能对比
+		*/
+		void EnableKeyCache(bool enable);
+
+		/*启用或禁用多线程编解码 默认启用 对所有资源对象生效
+		* 禁用后在调用线程依次处理 输出与并行处理相同 用于性能对比和校验
+		*/
+		static void EnableParallel(bool enable);
+
+#if MUI_CFG_ENABLE_V2DMRES
+		/*校验资源内容哈希 校验加密后的数据 不需要秘钥和解密
+		* @param resname - 资源名称 为空时校验全部资源
+		*
+		* @return 资源不存在或内容与哈希不符返回false 没有哈希的资源(从v1格式加载或尚未保存)视为通过
+		*/
+		bool VerifyResource(std::wstring resname = L"");
+
+		/*枚举资源名称和内容哈希 哈希来自v2格式目录 不读取资源数据
+		* @param out list - 资源名称和哈希 没有哈希的资源(从v1格式加载或尚未保存)哈希为0
+		*/
+		bool EnumResourceHash(std::vector<std::pair<std::wstring, _m_ulong64>>& list);
+
+		/*以追加模式保存到加载的文件 只追加新增和修改的资源数据 然后追加新的目录并更新文件头
+		* 重命名和删除资源只改变目录 被替换和删除的资源数据占用的空间使用Compact回收
+		* 仅支持以文件模式或内存模式从v2格式文件加载的资源
+		*/
+		bool SaveResourceAppend();
+
+		/*转换资源文件到v2格式 源文件可以是v1或v2格式
+		* @param srcfile - 源文件路径
+		* @param dstfile - 目标文件路径 不能与源文件相同
+		*/
+		static bool ConvertResource(std::wstring srcfile, std::wstring dstfile);
+#endif
 
 		//关闭资源文件 成功后可以重新初始化资源
 		bool CloseResource();
@@ -153,20 +226,93 @@ namespace Mui {
 	private:
 		_m_byte* HexStringToBytes(std::string str);
 		std::string Sha256StringHex(std::wstring str);
-        std::wstring wchar16Towchar32(char16_t * wchar16, _m_uint len);
+        static std::wstring wchar16Towchar32(const char16_t * wchar16, _m_uint len);
         char16_t * wchar32Towchar16(wchar_t  * wchar32, _m_uint len);
+		//由资源秘钥派生的AES密钥和扩展密钥
+		struct DMKeySchedule
+		{
+			_m_byte key[32] = { 0 };
+			_m_byte iv[16] = { 0 };
+			_m_byte roundKey[240] = { 0 };
+		};
+		//从缓存获取秘钥派生结果 不存在时计算并缓存 读取缓存时无需加锁
+		DMKeySchedule GetKeySchedule(const std::wstring& key);
+		//使用秘钥派生结果加密或解密到out out长度不能小于src.size
+		static void CipherTo(UIResource src, _m_byte* out, const DMKeySchedule& schedule, bool encrypt);
 		//加密资源
-		UIResource Enciphering(UIResource res, std::wstring key);
-		UIResource EncipheringText(std::wstring text, std::wstring key);
+		UIResource Enciphering(UIResource res, const std::wstring& key);
+		UIResource EncipheringText(std::wstring text, const std::wstring& key);
 		//解密资源
-		UIResource Deciphering(UIResource res, std::wstring key);
-		std::wstring DecipheringText(UIResource res, std::wstring key);
-		//编码块资源
-		void EncBlockProc(UIResource res, std::wstring resname, std::wstring key, _m_uint blocksize, UIResource* ret, DMEncBlockCallback callback);
-		UIResource EncBlockResource(UIResource res, std::wstring resname, std::wstring key, _m_uint blocksize, DMEncBlockCallback callback);
+		UIResource Deciphering(UIResource res, const std::wstring& key);
+		std::wstring DecipheringText(UIResource res, const std::wstring& key);
+		//编码块资源 compress为true时按块压缩
+		void EncBlockProc(UIResource res, std::wstring resname, std::wstring key, _m_uint blocksize, UIResource* ret, DMEncBlockCallback callback, bool compress);
+		UIResource EncBlockResource(UIResource res, std::wstring resname, std::wstring key, _m_uint blocksize, DMEncBlockCallback callback, bool compress = false);
+		//解码块资源
+		UIResource DecBlockResource(UIResource res, const std::wstring& key, _m_uint blocksize);
+		/*分块加密或解密资源 每个块都从同一IV开始 互相独立 数据量较大时并行处理
+		* @param progress - 每完成一个块时以该块字节数调用 可能在多个线程中调用 可为空
+		*/
+		void CipherBlocks(UIResource src, _m_byte* out, const std::wstring& key, _m_uint blocksize, bool encrypt,
+			const std::function<void(_m_size)>& progress);
+		/*使用常驻线程池并行处理count个任务 当前线程也参与处理
+		* @param workSize - 任务涉及的总数据量 数据量较小或只有一个任务时在当前线程依次处理
+		*/
+		static void ParallelFor(_m_size count, _m_size workSize, const std::function<void(_m_size)>& proc);
+
+		/*压缩并加密一个数据单元 每个单元都从同一IV开始
+		* @param out compressed - 是否已压缩 压缩后不小于原数据时保存原数据
+		*/
+		static UIResource EncodeChunk(UIResource src, const DMKeySchedule& schedule, bool& compressed);
+		//解密并解压一个数据单元 len等于rawLen时为未压缩的数据
+		static bool DecodeChunk(const _m_byte* src, _m_size len, _m_byte* out, _m_size rawLen, const DMKeySchedule& schedule);
+		/*按块压缩并加密资源 每个块单独压缩
+		* 结构为 [加密的块结束位置表 每块一个UINT 位置相对于数据开头][各块数据]
+		*/
+		UIResource EncCompressedBlocks(UIResource res, const std::wstring& key, _m_uint blocksize, const std::function<void(_m_size)>& progress);
 
 		//加载资源列表
 		bool LoadResList(bool file = false);
+		//资源列表读取游标
+		class DMResCursor;
+
+		/*资源文件数据源 以文件模式或映射模式加载时创建
+		* 由加载的资源项和数据流共同持有 关闭资源后仍在使用的快照和数据流继续有效
+		* 最后一个持有者释放时关闭文件和取消映射
+		*/
+		class DMResSource
+		{
+		public:
+			DMResSource() = default;
+			~DMResSource();
+			DMResSource(const DMResSource&) = delete;
+			DMResSource& operator=(const DMResSource&) = delete;
+
+			//以随机读取方式打开文件 失败返回nullptr
+			static std::shared_ptr<DMResSource> Open(const std::wstring& path);
+			//以只读方式映射文件 失败返回nullptr
+			static std::shared_ptr<DMResSource> Map(const std::wstring& path);
+
+			//从文件指定位置读取 不使用共享的文件指针 可以在多个线程中同时调用
+			bool ReadAt(_m_ulong64 pos, void* dst, _m_size len) const;
+
+			//映射视图 文件模式为nullptr
+			[[nodiscard]] const _m_byte* View() const { return m_view; }
+			//打开时的文件尺寸
+			[[nodiscard]] _m_ulong64 Size() const { return m_size; }
+
+		private:
+#ifdef _WIN32
+			//使用FILE_FLAG_OVERLAPPED打开 多个线程的读取可以同时进行
+			HANDLE m_file = INVALID_HANDLE_VALUE;
+#endif
+#ifdef __ANDROID__
+			int m_file = -1;
+#endif
+			_m_byte* m_view = nullptr;
+			_m_ulong64 m_size = 0;
+		};
+		using DMResSourcePtr = std::shared_ptr<DMResSource>;
 
 		//资源头
 		struct DMResHeader
@@ -181,6 +327,8 @@ namespace Mui {
 			_m_uint rescount = 0;
 		};
 
+		using DMResBuffer = std::shared_ptr<_m_byte[]>;
+
 		struct DMResItem
 		{
 			std::wstring resname;//资源名称
@@ -188,16 +336,185 @@ namespace Mui {
 			bool block = false;//块资源模式
 			_m_uint blockSize = 0;//块尺寸
 			UIResource text;//被加密过的文本资源
-			std::pair<_m_ulong, _m_uint> resPos;//资源在文件位置的指针
-			std::pair<_m_ulong, _m_uint> strPos;//文本在文件位置的指针
+			std::pair<_m_ulong64, _m_uint> resPos;//资源在文件位置的指针
+			std::pair<_m_ulong64, _m_uint> strPos;//文本在文件位置的指针
+			//内存模式下持有res和text的数据 在引用该项的所有快照释放后才释放
+			DMResBuffer resBuffer;
+			DMResBuffer textBuffer;
+			//压缩存储 res为压缩后加密的数据 rawSize为原数据尺寸
+			bool compress = false;
+			_m_uint rawSize = 0;
+			//v2格式的名称哈希和内容哈希
+			_m_ulong64 nameHash = 0;
+			_m_ulong64 resHash = 0;
+			_m_ulong64 textHash = 0;
+			//数据或文本位于加载的v2格式文件中 此时resPos或strPos以及对应的内容哈希有效
+			bool resStored = false;
+			bool textStored = false;
+			//从文件模式或映射模式加载的资源项持有数据源 文件模式未加载的数据从数据源读取
+			DMResSourcePtr source;
 		};
 
-		std::vector<DMResItem> dmResList;
+		//资源列表快照 发布后不再修改 读取时无需加锁
+		struct DMResSnapshot
+		{
+			std::vector<DMResItem> list;
+			//资源名称 -> list下标
+			std::unordered_map<std::wstring, size_t> index;
+			//list按名称哈希排序且没有建立名称索引 从v2格式加载时使用二分查找
+			bool sorted = false;
+
+			//查找资源项 未找到返回nullptr
+			[[nodiscard]] const DMResItem* Find(const std::wstring& resname) const;
+			//建立名称索引 之后按名称索引查找
+			void BuildIndex();
+		};
+		using DMResSnapshotPtr = std::shared_ptr<const DMResSnapshot>;
+
+		//获取当前快照
+		[[nodiscard]] DMResSnapshotPtr GetSnapshot() const { return std::atomic_load(&m_snapshot); }
+
+		/*复制当前快照并修改 然后发布为新快照 写入者之间使用mx互斥
+		* @param modify - 修改函数 返回false时放弃修改
+		*/
+		bool ModifyResList(const std::function<bool(DMResSnapshot&)>& modify);
+
+		//设置资源项数据 接管由new[]分配的data
+		static void SetItemData(UIResource& dst, DMResBuffer& buffer, UIResource data);
+
+		//解析v1格式资源列表
+		bool ParseResListV1(DMResCursor& cursor, bool files, DMResSnapshot& snapshot);
+		//写入v1格式资源文件
+		bool WriteResListV1(FILE* file, const DMResSnapshot& snapshot);
+#if MUI_CFG_ENABLE_V2DMRES
+		//v2格式文件头和目录项
+		struct DMResV2Header;
+		struct DMResV2Entry;
+		//解析v2格式资源列表
+		bool ParseResListV2(DMResCursor& cursor, bool files, DMResSnapshot& snapshot);
+		//写入v2格式资源文件
+		bool WriteResListV2(FILE* file, const DMResSnapshot& snapshot);
+		//追加资源列表中未保存的数据和新的目录到v2格式文件 并更新资源项位置
+		bool AppendResListV2(FILE* file, DMResSnapshot& snapshot);
+		/*生成v2格式目录和字符串表 目录按名称哈希排序 不包含数据位置和哈希
+		* @param out order - 目录项对应的资源项
+		* @param out classLen - 字符串表开头加密类名的长度
+		*/
+		void MakeTocV2(const DMResSnapshot& snapshot, std::vector<const DMResItem*>& order, std::vector<DMResV2Entry>& toc,
+			std::vector<_m_byte>& strTable, _m_uint& classLen);
+		//写入v2格式目录和字符串表 然后更新文件头
+		static bool WriteTocV2(FILE* file, const DMResV2Header& header, const std::vector<DMResV2Entry>& toc,
+			const std::vector<_m_byte>& strTable);
+#endif
+		//以读写方式打开文件
+		static FILE* OpenWriteFile(const std::wstring& path, bool append);
+		//使用64位位置移动和获取文件指针 支持超过2GB的文件
+		static bool SeekFile(FILE* file, _m_ulong64 pos, int origin);
+		static _m_long64 TellFile(FILE* file);
+		//以文件模式加载 资源数据按需从文件读取
+		[[nodiscard]] bool IsFileMode() const { return m_source && !m_source->View(); }
+		//以映射模式加载 资源为只读
+		[[nodiscard]] bool IsMapped() const { return m_source && m_source->View(); }
+		//设置加载的资源项数据 映射模式直接指向视图 内存模式复制数据
+		void SetLoadedData(UIResource& dst, DMResBuffer& buffer, const _m_byte* data, _m_uint size);
+		/*获取资源项加密后的数据 文件模式从数据源读取到buffer
+		* @param text - 获取文本数据
+		* @param out dst - 数据 指向资源项或buffer
+		*/
+		bool GetItemRaw(const DMResItem& item, bool text, std::vector<_m_byte>& buffer, UIResource& dst);
+		//获取资源项加密数据中的一段 文件模式从数据源读取到buffer 越界或失败返回nullptr
+		const _m_byte* ReadItemRange(const DMResItem& item, _m_size pos, _m_size len, std::vector<_m_byte>& buffer);
+		//读取压缩块资源的块结束位置表
+		bool ReadChunkTable(const DMResItem& item, const DMKeySchedule& schedule, std::vector<_m_uint>& ends);
+		//解码压缩资源中[offset, offset + len)范围的原数据到out 块模式只解码涉及的块
+		bool DecCompressed(const DMResItem& item, const std::wstring& key, _m_size offset, _m_size len, _m_byte* out);
+		//将字符串以UTF-16编码追加到dst
+		static void AppendUTF16(const std::wstring& str, std::vector<char16_t>& dst);
+		//计算资源名称哈希 使用UTF-16编码计算 与平台无关
+		static _m_ulong64 HashName(const std::wstring& name);
+
+		friend class DMResStream;
+
+		DMResSnapshotPtr m_snapshot;
 		DMResHeader m_resheader;
 		UIResource m_resource;
-		FILE* m_files = nullptr;
+		//文件模式或映射模式加载的数据源 新加载的资源项持有该数据源
+		DMResSourcePtr m_source;
+		//加载的文件路径
+		std::wstring m_filePath;
+		//加载的文件是v2格式 可以追加保存
+		bool m_v2File = false;
 
+		//写入者锁 读取操作不需要加锁
 		std::mutex mx;
+
+		//秘钥派生缓存 发布后不再修改 新增秘钥时复制并替换 m_keyLock仅用于新增者之间互斥
+		using DMKeyCache = std::unordered_map<std::wstring, DMKeySchedule>;
+		std::shared_ptr<const DMKeyCache> m_keyCache;
+		std::mutex m_keyLock;
+		std::atomic_bool m_keyCacheEnabled = true;
+	};
+
+	/*梦月资源数据流
+	* 由DMResources::OpenStream创建 持有资源的数据源或内存数据 并缓存最近解密的数据块
+	* 数据流对象不是线程安全的 不同线程请使用各自的数据流
+	*/
+	class DMResStream : public RAII::MBasicObj
+	{
+	public:
+		/*读取数据
+		* @param dst - 目标缓冲区
+		* @param len - 要读取的长度
+		*
+		* @return 实际读取的字节数 到达末尾返回0
+		*/
+		_m_size Read(void* dst, _m_size len);
+
+		/*移动读取位置
+		* @param offset - 偏移量
+		* @param origin - 起始位置 SEEK_SET SEEK_CUR SEEK_END
+		*
+		* @return 目标位置超出资源范围返回false
+		*/
+		bool Seek(_m_long64 offset, int origin = SEEK_SET);
+
+		//获取当前读取位置
+		[[nodiscard]] _m_size Tell() const { return m_pos; }
+
+		//获取资源数据总长度
+		[[nodiscard]] _m_size GetSize() const { return m_size; }
+
+	private:
+		DMResStream() = default;
+
+		//获取解密后的数据单元 优先从缓存中读取
+		const std::vector<_m_byte>* GetUnit(_m_size index);
+		//读取原始数据
+		bool ReadRaw(_m_size pos, _m_size len, _m_byte* dst);
+
+		//非块模式资源的数据单元尺寸 必须是16的整数倍
+		static constexpr _m_size unitSize = 64 * 1024;
+		//缓存的数据单元数量
+		static constexpr size_t cacheMax = 4;
+
+		DMResources::DMKeySchedule m_schedule;
+		//文件模式从数据源的m_dataPos位置读取 映射模式持有m_data所在的视图
+		DMResources::DMResSourcePtr m_source;
+		_m_ulong64 m_dataPos = 0;
+		const _m_byte* m_data = nullptr;
+		//持有内存模式的资源数据
+		DMResources::DMResBuffer m_buffer;
+		_m_size m_size = 0;
+		_m_size m_unit = 0;
+		bool m_block = false;
+		//压缩资源 m_size为原数据尺寸 m_stored为压缩数据尺寸 m_chunks为块模式的块结束位置表
+		bool m_compress = false;
+		_m_size m_stored = 0;
+		std::vector<_m_uint> m_chunks;
+		_m_size m_pos = 0;
+		std::list<std::pair<_m_size, std::vector<_m_byte>>> m_cache;
+
+		friend class DMResources;
 	};
 
 }
@@ -20,6 +20,11 @@
 */
 #pragma once
 #include <set>
+#include <map>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
+#include <chrono>
 #include <Render/Graphs/Mui_RenderDef.h>
 #include <FileSystem/DreamMoonRes.h>
 #define MUIRESFILE std::pair<Mui::DMResources*, std::wstring>
@@ -34,6 +39,7 @@ namespace Mui
 	};
 
 	class UIResourceMgr;
+	class UIStyleGeometry;
 
 	namespace Window { class UIWindowBasic; }
 
@@ -45,11 +51,24 @@ namespace Mui
 		UIBitmap& operator=(const UIBitmap&) = delete;
 		UIBitmap& operator=(UIBitmap&&) = delete;
 
-		Render::Def::MBitmapPtr GetBitmap() const { return m_bitmap; }
+		//异步加载完成前返回nullptr 可在任意线程调用
+		Render::Def::MBitmapPtr GetBitmap() const
+		{
+			if (m_loading)
+				return nullptr;
+			std::lock_guard lock(m_bitmapLock);
+			return m_bitmap;
+		}
+
+		//是否正在异步加载 加载失败时GetBitmap仍返回nullptr
+		[[nodiscard]] bool IsLoading() const { return m_loading; }
 
 	protected:
 		UIBitmap() = default;
 		Render::Def::MBitmapPtr m_bitmap = nullptr;
+		//m_bitmap在加载完成前由解码线程写入 之后只有ReloadResource会替换 替换和GetBitmap持有该锁
+		mutable std::mutex m_bitmapLock;
+		std::atomic_bool m_loading = false;
 
 		friend class UIResourceMgr;
 	};
@@ -88,41 +107,149 @@ namespace Mui
 
 	using UIStylePtr = RAII::Mui_Ptr<UIStyle>;
 
+	//共享位图缓存统计
+	struct UIBitmapCacheStats
+	{
+		_m_size hits = 0;			//命中次数
+		_m_size misses = 0;			//未命中次数
+		_m_size evictions = 0;		//淘汰次数
+		_m_size residentBytes = 0;	//缓存中的位图字节数 按32位像素计算 按名称累计 包括图集页 预算按该值计算
+		_m_size count = 0;			//缓存中的位图数量
+		_m_size budget = 0;			//字节预算 0为不限制
+		_m_size uniqueBytes = 0;	//实际的位图字节数 不同名称的相同内容只计算一次 包括图集页
+		_m_size dedupHits = 0;		//创建位图时复用相同内容位图的次数
+	};
+
+	//图形命令Style解析统计 时间单位为微秒
+	struct UIStyleParseStats
+	{
+		_m_size xmlCount = 0;		//从xml解析的Style数量
+		_m_size xmlTime = 0;		//xml解析总耗时
+		_m_size codeCount = 0;		//从字节码加载的Style数量
+		_m_size codeTime = 0;		//字节码加载总耗时
+	};
+
+	//资源加载统计 用于比较使用预取清单前后的启动耗时 时间单位为微秒
+	struct UIResourceLoadStats
+	{
+		_m_size syncCount = 0;		//在调用线程创建Style和共享位图的次数 包括取得预取结果
+		_m_size syncTime = 0;		//同步创建和等待预取完成的总耗时
+		_m_size prefetchHits = 0;	//使用时已由后台预取创建的Style数量
+		_m_size manifestCount = 0;	//已按预取清单发起预取的数量
+	};
+
+	//资源管理器的操作 用于统计和跟踪
+	enum class UIResourceOp
+	{
+		ReadResource,		//从资源文件读取和解密资源
+		DecodeBitmap,		//解码资源并创建位图
+		LoadStyle,			//从资源文件创建Style
+		SharedBitmap,		//CreateSharedUIBitmap缓存未命中时的加载
+		GeometryStyle,		//从xml创建图形命令Style
+		GeometryCode,		//从字节码创建图形命令Style
+		Count
+	};
+
+	//单项操作统计 时间单位为微秒
+	struct UIResourceOpStats
+	{
+		_m_size count = 0;			//调用次数
+		_m_size fails = 0;			//失败次数
+		_m_size time = 0;			//总耗时
+		_m_size maxTime = 0;		//单次最大耗时
+		_m_size bytes = 0;			//处理的资源字节数
+	};
+
+	//跟踪回调参数 回调可能在预取 解码和窗口线程调用
+	struct UIResourceTraceEvent
+	{
+		UIResourceOp op = UIResourceOp::ReadResource;
+		std::wstring_view name;		//资源名称 没有名称时为空
+		_m_size time = 0;			//耗时(微秒)
+		_m_size bytes = 0;
+		bool success = false;
+	};
+
+	//资源管理器统计
+	struct UIResourceStats
+	{
+		_m_size resFileCount = 0;		//资源文件数量
+		_m_size nameCount = 0;			//名称目录中的资源数量
+		_m_size styleCount = 0;			//Style列表数量
+		_m_size lazyStyleCount = 0;		//已登记尚未创建的Style数量
+		_m_size imageStyleCount = 0;
+		_m_size geometryStyleCount = 0;
+		UIResourceOpStats op[(size_t)UIResourceOp::Count];
+		UIBitmapCacheStats bitmapCache;
+		UIResourceLoadStats load;
+		//读取失败的资源名称 最多记录256个
+		std::vector<std::wstring> missNames;
+	};
+
 	class UIResourceMgr final
 	{
 	public:
-		explicit UIResourceMgr(Render::MRenderCmd* render) : m_render(render) {}
+		/* @param window - 异步加载的位图完成时通知该窗口重绘 可为空
+		 */
+		explicit UIResourceMgr(Render::MRenderCmd* render, Window::UIWindowBasic* window = nullptr)
+			: m_render(render), m_window(window) {}
 		UIResourceMgr(UIResourceMgr&&) = delete;
 		UIResourceMgr(const UIResourceMgr&) = delete;
 		UIResourceMgr& operator=(const UIResourceMgr&) = delete;
 		UIResourceMgr& operator=(UIResourceMgr&&) = delete;
 		~UIResourceMgr();
 
-		bool AddResourcePath(std::wstring_view path, std::wstring_view key);
+		/* 添加资源文件 资源名称加入名称目录
+		 * 多个资源文件存在同名资源时 以先添加的资源文件为准
+		 * @param mapped - 使用内存映射直接读取原文件 不复制 映射失败时使用文件读取模式
+		 * 映射期间原文件在Windows上无法被覆盖写入 在POSIX上被截断后访问映射会触发SIGBUS
+		 * 需要运行时覆盖写入并ReloadResource的资源文件应使用文件读取模式
+		 */
+		bool AddResourcePath(std::wstring_view path, std::wstring_view key, bool mapped = false);
 		bool AddResourceMem(UIResource memfile, std::wstring_view key);
 
 		//删除资源文件引用 如果有正在使用的共享的资源 这将导致共享资源在需要重载时无法加载
 		bool RemoveResource(std::wstring_view path);
 
+		/* 重新加载已添加的资源文件 资源文件在运行时被修改后更新界面 不需要重新创建窗口
+		 * 按内容哈希比较新旧资源 只重建内容改变的Style和共享位图 并替换到原对象中 控件持有的指针保持有效
+		 * 只有位图内容改变且尺寸不变时仅重绘窗口 否则重新布局
+		 * 从v1格式加载的资源没有内容哈希 读取新旧资源解密后的内容计算哈希比较
+		 * 类型改变的Style使用新对象替换 已持有旧指针的控件在重新查找Style前继续使用旧Style
+		 * 应在使用资源管理器的线程调用 文件监视回调需要转到该线程
+		 * 使用添加时的读取方式 映射模式的资源文件在映射期间不能原地修改 需要热重载时应以文件读取模式添加
+		 * @param path - AddResourcePath使用的路径
+		 * @return 资源文件未添加或加载失败返回false 此时保留原资源文件
+		 */
+		bool ReloadResource(std::wstring_view path);
+
 		/* 从已加载的Style列表中查找
+		 * 延迟加载的Style在首次查找时创建 创建失败将从列表移除
 		 * @param name - Style名称
 		 * @return UIStyle* 该指针由资源管理器管理 不可释放
 		 */
 		UIStyle* FindStyle(std::wstring_view name);
 
-		/* 从已添加的所有资源文件中加载Style到列表
-		 * 已有或重名的不会重复加载
-		 * @exception MErrorCode::InvalidParameter
+		/* 从已添加的所有资源文件中登记Style到列表
+		 * 仅登记名称 Style在首次FindStyle时才读取资源并创建
+		 * 已有或重名的不会重复登记
 		 */
 		void LoadStyleList();
 
 		/* 从资源文件中加载Style到列表
+		 * 列表中已登记但尚未创建的Style将立即创建
 		 * @param resname - 在资源文件中的名称
 		 * @param out dst - 输出UIStyle指针 可为空 不接收 (默认nullptr)
 		 * @return 如果找不到资源项目或者列表已存在同名资源将失败(false)
 		 */
 		bool LoadStyle(std::wstring_view resname, UIStyle** dst = nullptr);
 
+		/* 在后台线程预先创建已登记的Style
+		 * 多次调用将追加到预取列表 FindStyle取到正在预取的Style时等待其完成
+		 * @param names - Style名称列表 未登记或已创建的将被忽略
+		 */
+		void PrefetchStyle(const std::vector<std::wstring>& names);
+
 		/* 从内存创建ImageStyle 并添加到列表
 		 * @param name - Style名称
 		 * @param memimg - 内存图像资源
@@ -143,6 +270,25 @@ namespace Mui
 		 */
 		bool AddGeometryStyle(std::wstring_view name, std::wstring_view xml, UIStyle** dst = nullptr);
 
+		/* 从预编译的图形命令字节码创建Style 并添加到列表 不解析xml
+		 * @param name - Style名称
+		 * @param code - CompileGeometryStyle生成的字节码 内存由调用方管理
+		 * @param out dst - 输出UIStyle指针 可为空 不接收 (默认nullptr)
+		 * @return 重名或字节码无效将导致失败(false)
+		 */
+		bool AddGeometryStyle(std::wstring_view name, UIResource code, UIStyle** dst = nullptr);
+
+		/* 将图形命令xml编译为字节码
+		 * 字节码可存入资源文件(Style类型3) 或作为常量表嵌入代码 加载时不需要解析xml
+		 * @param xml - 图形命令xml代码
+		 * @param out dst - 输出字节码
+		 * @return xml代码格式无效将导致失败(false)
+		 */
+		static bool CompileGeometryStyle(std::wstring_view xml, std::vector<_m_byte>& dst);
+
+		//获取图形命令Style解析统计
+		UIStyleParseStats GetStyleParseStats();
+
 		/* 从列表移除Style
 		 * 此函数将Style从资源管理器的列表移除 不再管理 需要手动调用MSafeRelease释放资源
 		 * @return 返回目标Style指针
@@ -173,40 +319,275 @@ namespace Mui
 		 * @param - name 资源名称
 		 * @return 如果资源读取成功 返回位图指针 否则返回nullptr
 		 * 多次创建同一资源名将只返回同一对象 共同使用
+		 * 不同资源名但内容相同时使用同一MBitmap 只解码一次
 		 */
 		UIBitmapPtr CreateSharedUIBitmap(std::wstring_view name);
 
+		/* 异步从资源文件创建共享UI位图
+		 * 立即返回占位位图 资源读取和解密在后台线程完成 位图创建在渲染线程完成
+		 * 加载完成前GetBitmap返回nullptr 完成后通知窗口重新布局和重绘
+		 * 同名的共享位图正在加载时CreateSharedUIBitmap也将返回占位位图
+		 * @param name - 资源名称
+		 * @return 资源不存在返回nullptr
+		 */
+		UIBitmapPtr CreateSharedUIBitmapAsync(std::wstring_view name);
+
+		/* 异步从资源文件创建独立UI位图
+		 * 加载方式与CreateSharedUIBitmapAsync相同
+		 * @param name - 资源名称
+		 * @return 资源不存在返回nullptr
+		 */
+		UIBitmapPtr CreateUniqueUIBitampAsync(std::wstring_view name);
+
+		/* 设置共享位图缓存的字节预算
+		 * 超出预算时按最近最少使用顺序淘汰只被缓存引用的位图 淘汰的位图在下次使用时从资源文件重新加载
+		 * 从资源文件加载的图像Style也使用该缓存
+		 * @param bytes - 字节预算 0为不限制 (默认64MB)
+		 */
+		void SetBitmapCacheBudget(_m_size bytes);
+
+		//获取共享位图缓存统计
+		UIBitmapCacheStats GetBitmapCacheStats();
+
+		/* 将已创建的小尺寸图像Style打包到共享的图集页 减少位图数量和绘制时的位图切换
+		 * 应在加载完成 窗口开始绘制前调用 尚未创建的延迟Style不参与打包 再次调用时仅打包新创建的Style
+		 * 图集页计入共享位图缓存的字节数 不会被淘汰 不再被Style引用后移除
+		 * @param pageSize - 图集页最大边长 (默认1024)
+		 * @param maxSize - 宽高均不超过该值的图像才会打包 (默认128)
+		 * @return 新建的图集页数量
+		 */
+		_m_uint BuildStyleAtlas(_m_uint pageSize = 1024, _m_uint maxSize = 128);
+
+		/* 开始记录使用的资源名称 用于生成启动预取清单
+		 * 记录调用后duration毫秒内首次使用的Style和共享位图 按使用顺序保存
+		 * @param duration - 记录时长(毫秒)
+		 */
+		void BeginRecordManifest(_m_uint duration = 3000);
+
+		/* 保存记录的预取清单 每行为类型(s=Style b=共享位图)和资源名称
+		 * @param path - 清单文件路径
+		 */
+		bool SaveManifest(std::wstring_view path);
+
+		/* 加载预取清单 Style交给预取线程创建 共享位图交给解码线程并行创建
+		 * 名称所在的资源文件添加后才会预取 可在AddResourcePath之前调用 添加资源文件时自动预取新加入的名称
+		 * @param path - 清单文件路径
+		 * @return 清单文件不存在或读取失败返回false
+		 */
+		bool LoadManifest(std::wstring_view path);
+
+		//获取资源加载统计
+		UIResourceLoadStats GetLoadStats();
+
+		//获取资源管理器统计
+		UIResourceStats GetStats();
+
+		/* 设置跟踪回调 每次统计的操作完成时调用
+		 * 回调可能在预取 解码和窗口线程调用 不能在回调中调用资源管理器
+		 * @param callback - 跟踪回调 为空时取消
+		 */
+		void SetTraceCallback(std::function<void(const UIResourceTraceEvent&)> callback);
+
+		/* 将统计以及缓存中的位图列表写入JSON文件
+		 * @param path - 文件路径
+		 */
+		bool DumpStats(std::wstring_view path);
+
 	private:
 		Render::MRenderCmd* m_render = nullptr;
+		Window::UIWindowBasic* m_window = nullptr;
 		struct resfile
 		{
 			MUIRESFILE file;
 			std::wstring path;
+			bool mapped = false;
 		};
 		std::vector<resfile> m_resList;
+		//所有资源文件的名称目录 资源名称->m_resList索引
+		std::unordered_map<std::wstring, size_t> m_nameDir;
+		//Style绘制时可能在窗口线程重新加载位图 添加和删除资源文件时独占
+		std::shared_mutex m_resLock;
 
 		struct StyleData
 		{
 			UIStylePtr style = nullptr;
 			bool memres = false;
 			std::wstring srcname;
+			//仅登记名称 尚未创建
+			bool lazy = false;
 		};
 		std::unordered_map<std::wstring, StyleData> m_styleList;
-		std::unordered_map<std::wstring, UIBitmap*> m_sharedBmpList;
+		//重新加载时因类型改变被替换的Style 控件可能仍持有指针 随资源管理器释放
+		std::vector<UIStylePtr> m_retiredStyle;
+
+		//共享位图缓存 缓存持有一个引用
+		struct SharedBitmap
+		{
+			UIBitmapPtr bitmap = nullptr;
+			_m_size bytes = 0;
+			std::list<std::wstring>::iterator lru;
+		};
+		std::unordered_map<std::wstring, SharedBitmap> m_sharedBmpList;
+		//最近使用顺序 开头为最近使用
+		std::list<std::wstring> m_sharedBmpLRU;
+		std::mutex m_sharedBmpLock;
+		UIBitmapCacheStats m_bmpStats = { 0, 0, 0, 0, 0, 64 * 1024 * 1024 };
+
+		//内容哈希和数据尺寸->位图 只被此表引用的位图在TrimSharedBitmap时移除 使用m_sharedBmpLock
+		struct ContentBitmap
+		{
+			Render::Def::MBitmapPtr bitmap = nullptr;
+			//位图的来源资源 哈希和尺寸相同时重新读取比较内容 不保留解码前的数据
+			std::wstring name;
+		};
+		std::map<std::pair<_m_ulong64, _m_size>, ContentBitmap> m_contentBmpList;
+		//图集页和字节数 使用m_sharedBmpLock
+		std::vector<std::pair<UIBitmapPtr, _m_size>> m_atlasPage;
+
+		//最近绘制过的图像Style 持有共享位图直到不再绘制 仅在渲染线程使用
+		std::vector<UIStylePtr> m_pinnedStyle;
+		_m_size m_paintFrame = 1;
+
+		//操作统计和跟踪 预取和解码线程也会更新
+		std::mutex m_statsLock;
+		UIResourceOpStats m_opStats[(size_t)UIResourceOp::Count];
+		std::vector<std::wstring> m_missNames;
+		std::shared_ptr<std::function<void(const UIResourceTraceEvent&)>> m_traceCallback;
+
+		//后台预取
+		struct PrefetchItem
+		{
+			std::wstring name;
+			MUIRESFILE file;
+		};
+		std::thread m_prefetchThread;
+		std::mutex m_prefetchLock;
+		std::condition_variable m_prefetchSignal;
+		std::deque<PrefetchItem> m_prefetchQueue;
+		//正在创建的Style名称
+		std::wstring m_prefetchCur;
+		//已创建 等待取走的Style
+		std::unordered_map<std::wstring, UIStylePtr> m_prefetchDone;
+		bool m_prefetchRunning = false;
+
+		//启动预取清单
+		struct ManifestItem
+		{
+			bool style = false;
+			std::wstring name;
+		};
+		std::atomic_bool m_manifestRecording = false;
+		std::chrono::steady_clock::time_point m_manifestEnd;
+		std::mutex m_manifestLock;
+		std::vector<ManifestItem> m_manifestRecord;
+		std::set<std::wstring> m_manifestRecorded;
+		//已加载 资源文件尚未添加的清单项
+		std::vector<ManifestItem> m_manifestPending;
+
+		std::atomic<_m_size> m_syncLoadCount = 0;
+		std::atomic<_m_size> m_syncLoadTime = 0;
+		std::atomic<_m_size> m_prefetchHits = 0;
+		_m_size m_manifestCount = 0;
+
+		//异步位图解码线程
+		std::vector<std::thread> m_decodeThreads;
+		std::deque<std::function<void()>> m_decodeQueue;
+		std::mutex m_decodeLock;
+		std::condition_variable m_decodeSignal;
+		std::condition_variable m_decodeIdle;
+		_m_uint m_decodeActive = 0;
+		bool m_decodeStop = false;
 
 		bool LoadStyleFromDMRes(MUIRESFILE& file, std::wstring_view name, std::wstring& dst,
 			bool res = false, UIResource* dstres = nullptr);
 
 		bool LoadStyleInternal(MUIRESFILE& file, std::wstring_view name, UIStyle** dststyle);
 
+		//从资源文件读取并创建Style 不添加到列表 可在预取线程调用
+		bool CreateStyleInternal(MUIRESFILE& file, std::wstring_view name, UIStyle** dststyle);
+
+		//创建延迟加载的Style 优先使用预取结果
+		bool MaterializeStyle(const std::wstring& name, StyleData& data);
+
+		void PrefetchProc();
+
+		//记录时长内首次使用的名称加入清单 可在任意线程调用
+		void RecordManifest(bool style, std::wstring_view name);
+		//预取清单中资源文件已添加的项
+		void ReplayManifest();
+		//累计调用线程同步加载的耗时
+		void AddSyncLoadTime(std::chrono::steady_clock::time_point begin);
+
+		//记录一次操作的统计并调用跟踪回调
+		void TraceOp(UIResourceOp op, std::wstring_view name, std::chrono::steady_clock::time_point begin,
+			_m_size bytes, bool success);
+
+		//解码资源并创建位图 记录DecodeBitmap统计
+		Render::Def::MBitmapPtr DecodeBitmap(UIResource res, std::wstring_view name);
+
+		//清空预取队列并等待预取线程退出
+		void StopPrefetch();
+
+		//在缓存中查找共享位图并更新使用顺序 需要持有m_sharedBmpLock
+		UIBitmapPtr FindSharedBitmap(const std::wstring& name);
+
+		//添加共享位图到缓存 同名位图已存在时返回已有位图
+		UIBitmapPtr AddSharedBitmap(const std::wstring& name, UIBitmapPtr bitmap);
+
+		//淘汰超出预算的位图 需要持有m_sharedBmpLock
+		void TrimSharedBitmap();
+
+		/* 开始绘制新的一帧 由窗口在渲染线程绘制控件树前调用
+		 * 上一帧未绘制的图像Style释放持有的共享位图 之后可以被淘汰
+		 */
+		void BeginFrame();
+
+		//添加异步加载位图任务 按需启动解码线程 shared为true时复用相同内容的位图
+		UIBitmapPtr LoadUIBitmapAsync(std::wstring_view name, bool shared);
+
+		void DecodeProc();
+
+		//等待已提交的解码任务全部完成
+		void WaitDecode();
+
+		//完成已提交的解码任务并退出解码线程
+		void StopDecode();
+
+		/* @param cacheName - 不为空时位图放入共享位图缓存 Style绘制时按该名称从缓存获取
+		 */
 		bool AddImageStyleInternal(UIResource memimg, _m_ushort count,
-			UIStyle** dst = nullptr, bool nineGrid = false, _m_rect_t<int> gridpath = { 0 });
+			UIStyle** dst = nullptr, bool nineGrid = false, _m_rect_t<int> gridpath = { 0 },
+			std::wstring_view cacheName = {});
 
 		bool AddGeometryStyleInternal(std::wstring_view xml, UIStyle** dst = nullptr);
 
-		void FreeResFile(MUIRESFILE& file);
+		bool AddGeometryCodeInternal(UIResource code, UIStyle** dst = nullptr);
+
+		//交换两个Style的内容 类型不同返回false
+		static bool SwapStyle(UIStyle* dst, UIStyle* src);
+
+		//解析图形命令xml/字节码到style的命令列表
+		static bool ParseGeometryXML(std::wstring_view xml, UIStyleGeometry* style);
+		static bool ParseGeometryCode(UIResource code, UIStyleGeometry* style);
+
+		//加载资源文件 mapped为true时直接映射原文件 失败时使用文件读取模式
+		static bool LoadResFile(DMResources* dmres, std::wstring_view path, bool mapped);
+
+		void FreeResFile(resfile& file);
+
+		//将m_resList[index]的资源名称加入目录 已存在的名称不覆盖
+		void AddNameDir(size_t index);
+		//从名称目录查找资源所在的资源文件 找不到返回nullptr
+		resfile* FindResFile(std::wstring_view name);
+
+		/* 从解密后的内容创建共享位图 已有相同内容的位图时直接复用
+		 * 确认内容相同时会读取资源 调用时不能持有m_sharedBmpLock和m_resLock
+		 * @param name - res的资源名称 之后用于重新读取比较
+		 */
+		Render::Def::MBitmapPtr CreateContentBitmap(UIResource res, std::wstring_view name);
 
 		friend class UIStyle;
+		friend class UIStyleImage;
 		friend class UIMgrResource;
 		friend class UIBitmapShared;
 		friend class UIBitmapSVG;
@@ -220,6 +601,15 @@ namespace Mui
 			_m_byte alpha, int state, _m_ushort count, _m_scale scale) override;
 
 		UIBitmapPtr m_bitmap = nullptr;
+		//m_bitmap为空时从资源管理器的共享位图缓存获取
+		UIResourceMgr* m_mgr = nullptr;
+		std::wstring m_cacheName;
+		//绘制时从缓存取得的位图 在不再绘制前保持引用 可见的位图不会被淘汰后在每帧重新解码
+		UIBitmapPtr m_pinned = nullptr;
+		_m_size m_pinFrame = 0;
+		bool m_pinListed = false;
+		//已打包到图集时 图像在m_bitmap中的区域
+		_m_rect m_atlasRect = { 0 };
 
 		friend class UIResourceMgr;
 	};
@@ -28,21 +28,36 @@
 //是否启用文件系统 DmResFile v1版本
 #define MUI_CFG_ENABLE_V1DMRES 1
 
+//是否启用 DmResFile v2容器格式 启用后读取时同时支持v1和v2格式 保存时默认仍使用v1格式 需要启用v1
+#define MUI_CFG_ENABLE_V2DMRES 1
+
 //是否启用 DmResFile v1的硬件加速 需要使用Cryptopp库
 #if (MUI_CFG_ENABLE_V1DMRES)
 #define MUI_CFG_ENABLE_CRYPTOPP 0
 #endif
 
+//是否使用lz4库压缩资源 需要添加lz4库的lz4.c和lz4.h 否则使用内置的lz4块格式实现 两者的压缩数据相互兼容
+#if (MUI_CFG_ENABLE_V2DMRES)
+#define MUI_CFG_ENABLE_LZ4LIB 0
+#endif
+
 #if (!MUI_CFG_ENABLE_V1DMRES && !MUI_CFG_ENABLE_V2DMRES)
 #error "没有可用的文件系统支持!"
 #endif
 
+#if (MUI_CFG_ENABLE_V2DMRES && !MUI_CFG_ENABLE_V1DMRES)
+#error "DmResFile v2容器格式需要启用v1 (MUI_CFG_ENABLE_V1DMRES)"
+#endif
+
 /*-------*/
 
 /*UI*/
 //是否启用控件默认样式 仅对MUI默认控件有效
 #define MUI_MXML_ENABLE_DEFSTYLE 1
 
+//默认样式是否从预编译的图形命令字节码加载 否则在启动时解析xml
+#define MUI_MXML_DEFSTYLE_BYTECODE 1
+
 //当MXML创建控件时遇到未知控件是否抛出异常
 #define MUI_MXML_THROW_UNKNOWCTRL 0
 /*-------*/
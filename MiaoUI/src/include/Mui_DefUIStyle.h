@@ -20,6 +20,7 @@
 */
 #pragma once
 #include <Mui_XML.h>
+#include <Mui_DefUIStyleCode.h>
 
 #if MUI_MXML_ENABLE_DEFSTYLE
 
@@ -43,7 +44,9 @@ namespace Mui::DefStyle
 		<DefPropGroup control="UIProgBar" style="_mui_def_progress" />
 	);
 
-	inline auto _g_mui_default_uistyle_loadxml(UIResourceMgr* mgr)
+	//按名称枚举默认样式的图形命令xml proc(name, xml)
+	template<typename Proc>
+	inline void _g_mui_default_uistyle_enumxml(Proc&& proc)
 	{
 		std::wstring xml = MXMLCODE(
 		<part>
@@ -67,7 +70,7 @@ namespace Mui::DefStyle
 			<fill_rect rc="5,b1,5,0" color="200,200,200,255" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_btn", xml);
+		proc(L"_mui_def_btn", xml);
 
 		xml = MXMLCODE(
 		<part>
@@ -115,7 +118,7 @@ namespace Mui::DefStyle
 			<fill_ellipse rc="5,5,5,5" color="175,175,175,255" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_chbox", xml);
+		proc(L"_mui_def_chbox", xml);
 
 		xml = MXMLCODE(
 		<part>
@@ -139,7 +142,7 @@ namespace Mui::DefStyle
 			<fill_rect rc="5,b1,5,0" color="200,200,200,255" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_cmlist", xml);
+		proc(L"_mui_def_cmlist", xml);
 
 		xml = MXMLCODE(
 		<part>
@@ -172,7 +175,7 @@ namespace Mui::DefStyle
 			<draw_round rc="0,0,0,0" value="6.0" color="190,190,190,255" width="1" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_cmitem", xml);
+		proc(L"_mui_def_cmitem", xml);
 
 		xml = MXMLCODE(
 		<part />
@@ -204,7 +207,7 @@ namespace Mui::DefStyle
 		<part />
 		<part />
 		);
-		mgr->AddGeometryStyle(L"_mui_def_scroll", xml);
+		proc(L"_mui_def_scroll", xml);
 
 		xml = MXMLCODE(
 		<part>
@@ -229,7 +232,7 @@ namespace Mui::DefStyle
 			<fill_rect rc="5,b1,5,0" color="200,200,200,255" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_edit", xml);
+		proc(L"_mui_def_edit", xml);
 
 		xml = MXMLCODE(
 		<part>
@@ -253,7 +256,7 @@ namespace Mui::DefStyle
 			<fill_rect rc="5,b1,5,0" color="200,200,200,255" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_list", xml);
+		proc(L"_mui_def_list", xml);
 
 		xml = MXMLCODE(
 		<part />
@@ -281,7 +284,7 @@ namespace Mui::DefStyle
 			<fill_round rc="0,5,l-5,5" value="2.0" color="180,180,180,255" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_listitem", xml);
+		proc(L"_mui_def_listitem", xml);
 
 		xml = MXMLCODE(
 		<part>
@@ -299,7 +302,7 @@ namespace Mui::DefStyle
 			<fill_round rc="0,0,0,0" value="2.0" color="130,130,130,255" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_strack", xml);
+		proc(L"_mui_def_strack", xml);
 
 		xml = MXMLCODE(
 		<part>
@@ -323,7 +326,7 @@ namespace Mui::DefStyle
 			<fill_ellipse rc="6,6,6,6" color="130,130,130,255" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_sbutton", xml);
+		proc(L"_mui_def_sbutton", xml);
 
 		xml = MXMLCODE(
 		<part>
@@ -341,8 +344,39 @@ namespace Mui::DefStyle
 			<fill_round rc="0,0,0,0" value="5.0" color="184,217,251,255" />
 		</part>
 		);
-		mgr->AddGeometryStyle(L"_mui_def_progress", xml);
+		proc(L"_mui_def_progress", xml);
+	}
+
+	inline auto _g_mui_default_uistyle_loadxml(UIResourceMgr* mgr)
+	{
+		_g_mui_default_uistyle_enumxml([mgr](std::wstring_view name, const std::wstring& xml)
+		{
+			mgr->AddGeometryStyle(name, xml);
+		});
+	}
+
+#if MUI_MXML_DEFSTYLE_BYTECODE && defined(_DEBUG)
+	//编译xml并与Mui_DefUIStyleCode.h中的字节码比较 修改xml后未重新生成字节码时返回false
+	inline bool _g_mui_default_uistyle_checkcode()
+	{
+		std::unordered_map<std::wstring, std::vector<_m_byte>> codeList;
+		_g_mui_default_uistyle_enumcode([&](std::wstring_view name, const _m_byte* code, _m_size size)
+		{
+			codeList[name.data()].assign(code, code + size);
+		});
+		bool match = true;
+		_g_mui_default_uistyle_enumxml([&](std::wstring_view name, const std::wstring& xml)
+		{
+			std::vector<_m_byte> code;
+			const auto iter = codeList.find(name.data());
+			if (iter == codeList.end() || !UIResourceMgr::CompileGeometryStyle(xml, code) || iter->second != code)
+				match = false;
+			if (iter != codeList.end())
+				codeList.erase(iter);
+		});
+		return match && codeList.empty();
 	}
+#endif
 }
 
 #endif
\ No newline at end of file
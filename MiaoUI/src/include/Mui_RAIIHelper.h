@@ -97,11 +97,12 @@ namespace Mui::RAII
 		MBasicObj& operator=(MBasicObj&&) = delete;
 
 		void AddRef() noexcept { ++m_ref; }
+		//获取当前引用计数
+		[[nodiscard]] int GetRefCount() const noexcept { return m_ref; }
 		void Release()
 		{
-			if (m_ref > 0)
-				--m_ref;
-			if (m_ref != 0)
+			//未被持有(引用计数为0)的对象直接销毁 否则原子地减少引用 只有减到0的线程销毁对象
+			if (m_ref.load() != 0 && --m_ref != 0)
 				return;
 			try
 			{
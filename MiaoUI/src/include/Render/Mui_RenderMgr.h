@@ -24,6 +24,7 @@
 #include <Render/Graphs/Mui_RenderDef.h>
 #include <functional>
 #include <future>
+#include <cstring>
 
 namespace Mui::Render
 {
@@ -112,6 +113,136 @@ namespace Mui::Render
 		std::atomic_int m_rear;
 	};
 
+	//多生产者单消费者无锁队列 push可在任意线程调用 pop和isEmpty只能在消费线程调用
+	template<class T>
+	class MMpscQueue
+	{
+	public:
+		MMpscQueue()
+		{
+			m_tail = new node();
+			m_head = m_tail;
+		}
+
+		~MMpscQueue()
+		{
+			T value;
+			while (pop(value));
+			delete m_tail;
+		}
+
+		MMpscQueue(const MMpscQueue&) = delete;
+		MMpscQueue& operator=(const MMpscQueue&) = delete;
+
+		void push(T&& value)
+		{
+			node* item = new node(std::move(value));
+			node* prev = m_head.exchange(item);
+			prev->next.store(item);
+		}
+
+		bool pop(T& value)
+		{
+			node* next = m_tail->next.load();
+			if (!next)
+				return false;
+			value = std::move(next->value);
+			delete m_tail;
+			m_tail = next;
+			return true;
+		}
+
+		//正在push的元素可能暂时不可见 push返回后一定可见
+		bool isEmpty()
+		{
+			return m_tail->next.load() == nullptr;
+		}
+
+	private:
+		struct node
+		{
+			std::atomic<node*> next = nullptr;
+			T value;
+
+			node() = default;
+			node(T&& _value) : value(std::move(_value)) {}
+		};
+		std::atomic<node*> m_head = nullptr;
+		node* m_tail = nullptr;
+	};
+
+	/*渲染命令缓冲区
+	* 记录模式下绘制命令以POD记录追加到线性内存 提交后由渲染线程按顺序回放
+	* 记录的对象会增加引用 回放后在渲染线程释放
+	*/
+	class MRenderCmdBuffer
+	{
+	public:
+		//追加一条命令
+		template<typename T>
+		void Push(_m_ushort type, const T& cmd)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			std::memcpy(Alloc(type, sizeof(T)), &cmd, sizeof(T));
+		}
+
+		//追加一条无参数命令
+		void Push(_m_ushort type)
+		{
+			Alloc(type, 0);
+		}
+
+		//持有对象引用直到回放结束
+		template<typename T>
+		T* Hold(const RAII::Mui_Ptr<T>& obj)
+		{
+			T* ptr = obj.get();
+			if (ptr)
+			{
+				ptr->AddRef();
+				m_refs.push_back(ptr);
+			}
+			return ptr;
+		}
+
+		bool Empty() const { return m_count == 0; }
+
+		_m_uint GetCount() const { return m_count; }
+
+		//清空命令并释放持有的对象 保留已分配的内存
+		void Reset();
+
+	private:
+		//命令头 参数紧随其后 每条命令按8字节对齐
+		struct header
+		{
+			_m_ushort type = 0;
+			_m_uint size = 0;
+		};
+		static_assert(sizeof(header) == 8);
+
+		_m_byte* Alloc(_m_ushort type, size_t size);
+
+		std::vector<_m_byte> m_data;
+		size_t m_size = 0;
+		_m_uint m_count = 0;
+		std::vector<RAII::MBasicObj*> m_refs;
+
+		friend class MRenderCmd;
+	};
+
+	//任务队列锁竞争统计 时间单位为微秒
+	struct MRenderCmdStats
+	{
+		_m_size enqueueCount = 0;		//入队时加锁的次数 包括同步任务 命令缓冲区和投递唤醒
+		_m_size contendedCount = 0;		//入队时锁已被占用的次数
+		_m_size lockWaitTime = 0;		//入队时等待锁的总时间
+		_m_size lockWaitMax = 0;		//入队时单次最大等待时间
+		_m_size postCount = 0;			//投递的异步任务数量
+		_m_size wakeCount = 0;			//投递时唤醒渲染线程的次数
+		_m_size batchCount = 0;			//渲染线程取出任务批次的次数
+	};
+
 	/*渲染命令队列
 	* 用于处理渲染命令的线程同步
 	*/
@@ -238,6 +369,19 @@ namespace Mui::Render
 			Task(std::move(task));
 		}
 
+		/* 投递异步任务 不等待执行完成
+		 * 任务在渲染线程按投递顺序执行 在渲染线程调用时直接执行
+		 * 同一线程先投递的任务总在之后的同步调用之前执行 与该线程已提交的记录命令按调用顺序执行
+		 * @param task - 任务
+		 * @param completion - 任务完成后在渲染线程调用 可以为空
+		 */
+		void Post(std::function<void()>&& task, std::function<void()>&& completion = nullptr);
+
+		/* 等待之前投递的异步任务执行完成
+		 * 异步任务发生的异常没有等待方 保留第一个并在此处抛出
+		 */
+		void WaitPost();
+
 		template<typename T>
 		T* GetBase() const
 		{
@@ -246,10 +390,47 @@ namespace Mui::Render
 
 		bool IsTaskThread();
 
+		/* 在当前线程开始记录模式
+		 * 之后当前线程的绘制和状态调用追加到命令缓冲区 不再逐个等待渲染线程
+		 * 缓冲区在EndDraw等同步调用或SubmitCommands时提交 由渲染线程按顺序回放
+		 * 资源创建和读取类调用仍为同步调用 在渲染线程调用时无效
+		 * 画笔和画刷的颜色 宽度和不透明度在记录时复制 之后修改不影响已记录的命令
+		 * 使用字体 渐变画刷 效果和批量位图的绘制无法复制对象状态 在记录模式下仍为同步调用
+		 * 同一时间只能有一个线程处于记录模式 其他线程需要等待该线程EndRecord后才能开始
+		 * @return 其他线程正在记录或在渲染线程调用时返回false 当前线程的调用仍为同步调用
+		 */
+		bool BeginRecord();
+
+		//提交剩余命令并结束当前线程的记录模式
+		void EndRecord();
+
+		//提交当前线程已记录的命令 不等待回放完成
+		void SubmitCommands();
+
+		//当前线程是否处于记录模式
+		bool IsRecording();
+
+		//获取任务队列锁竞争统计
+		MRenderCmdStats GetStats();
+
+		//重置任务队列锁竞争统计
+		void ResetStats();
+
 	private:
 		void ThreadProc();
 		void Task(std::function<void()>&& task);
 
+		//当前线程处于记录模式时返回命令缓冲区 否则返回nullptr
+		MRenderCmdBuffer* RecordBuffer();
+		//将已记录的命令缓冲区加入异步任务队列 需要持有m_tasklock
+		bool QueueRecordBuffer();
+		//在渲染线程回放命令缓冲区
+		void ReplayBuffer(MRenderCmdBuffer* buffer);
+		//执行已投递的全部异步任务
+		void RunPostTasks();
+		//入队时加锁 记录等待时间
+		std::unique_lock<std::mutex> LockTaskList();
+
 		MRender* m_base = nullptr;
 
 		//线程相关
@@ -258,14 +439,52 @@ namespace Mui::Render
 		std::atomic_bool m_stop;
 		std::thread m_thread;
 
+		//同步任务的完成通知 等待期间线程不会提交其他任务 因此每个线程复用一个
+		struct taskWaiter
+		{
+			std::mutex lock;
+			std::condition_variable signal;
+			bool done = false;
+			std::exception_ptr error = nullptr;
+		};
+
 		struct taskParam
 		{
 			std::function<void()> task = nullptr;
-			std::promise<void>& notification;
-			taskParam(std::function<void()>& _task, std::promise<void>& n) :
-				task(_task), notification(n) {}
+			taskWaiter* waiter = nullptr;
+			taskParam(std::function<void()>&& _task, taskWaiter* _waiter) :
+				task(std::move(_task)), waiter(_waiter) {}
 		};
+		//渲染线程在锁内与本地列表交换 执行期间不持有锁
 		std::vector<taskParam> m_taskList;
+		//使用m_tasklock
+		MRenderCmdStats m_stats;
+		std::atomic<_m_size> m_postCount = 0;
+
+		//记录模式 同一时间只有一个记录线程 m_recordBuf只由该线程访问
+		std::atomic<std::thread::id> m_recordThread;
+		std::unique_ptr<MRenderCmdBuffer> m_recordBuf = nullptr;
+		//回放完成可复用的缓冲区 使用m_tasklock
+		std::vector<std::unique_ptr<MRenderCmdBuffer>> m_freeBuffer;
+		//回放时发生的异常 在记录线程下次同步调用时抛出 使用m_tasklock
+		std::exception_ptr m_recordError = nullptr;
+		//异步任务发生的异常 在下次WaitPost时抛出 使用m_tasklock
+		std::exception_ptr m_postError = nullptr;
+		//回放画笔和画刷命令时设置记录的状态后使用 只在渲染线程访问
+		MPenPtr m_replayPen = nullptr;
+		MBrushPtr m_replayBrush = nullptr;
+
+		//异步任务 投递方只在渲染线程休眠时加锁唤醒
+		//异步任务和记录模式提交的命令缓冲区共用一个队列 同一线程的投递和提交按调用顺序执行
+		struct postTask
+		{
+			std::function<void()> task = nullptr;
+			std::function<void()> completion = nullptr;
+			//不为空时回放该缓冲区 task和completion为空
+			std::unique_ptr<MRenderCmdBuffer> buffer = nullptr;
+		};
+		MMpscQueue<postTask> m_postQueue;
+		std::atomic_bool m_sleeping = false;
 			
 		std::atomic_bool m_begindraw;
 
@@ -56,6 +56,12 @@ namespace Mui::Render
 		virtual void OnRender(MRenderCmd* render, void* data) = 0;
 		virtual void OnRenderChildEnd(MRenderCmd* render, void* data) = 0;
 
+		/* 获取Node的绘制范围 用于RenderTree裁剪
+		 * 子Node的绘制范围应位于父Node之内 范围外的Node连同子树一起跳过
+		 * @return 返回false则不参与裁剪
+		 */
+		virtual bool GetRenderRect(_m_rect& rect) { return false; }
+
 		MRenderNode(MNodeRoot* root);
 		void DelChildNode(std::vector<MRenderNode*>::iterator& iter);
 
@@ -86,13 +92,30 @@ namespace Mui::Render
 		virtual ~MNodeRoot();
 		[[nodiscard]] MRenderNode* RootNode() const;
 
-		void RenderTree(void* data);
+		/* 渲染Node树
+		 * @param data - 传递给Node的数据
+		 * @param cullRect - 裁剪区域数组 绘制范围与其中任一区域都不相交的Node及其子树将被跳过 nullptr=不裁剪
+		 * @param cullCount - 裁剪区域数量
+		 */
+		void RenderTree(void* data, const _m_rect* cullRect = nullptr, size_t cullCount = 1);
 
 		[[nodiscard]] size_t GetCount() const
 		{
 			return m_drawList.size();
 		}
 
+		//上一次RenderTree访问的Node数量 被跳过的子树不计入
+		[[nodiscard]] size_t GetVisitedCount() const
+		{
+			return m_visitedCount;
+		}
+
+		//上一次RenderTree调用OnRender的Node数量
+		[[nodiscard]] size_t GetDrawnCount() const
+		{
+			return m_drawnCount;
+		}
+
 		//设定回调后UnbindNodeRenderFunc时将会调用 通知控件树发生已变动
 		void SetUnBindCallback(std::function<void(MRenderNode*)>&& callback)
 		{
@@ -106,15 +129,23 @@ namespace Mui::Render
 		struct drawNode
 		{
 			MRenderNode* node = nullptr;
+			//子树在m_drawList中的结束位置 跳过子树时使用
+			size_t end = 0;
 		};
 		std::vector<drawNode> m_drawList;
+		//m_drawList已变动 需要重新计算子树范围
+		bool m_drawListChanged = false;
 		MRenderNode* m_rootNode = nullptr;
 		MRenderCmd* m_render = nullptr;
 
+		size_t m_visitedCount = 0;
+		size_t m_drawnCount = 0;
+
 		std::function<void(MRenderNode*)> m_callback = nullptr;
 
 		void BindNodeRenderFunc(MRenderNode* last, MRenderNode* node);
 		void UnbindNodeRenderFunc(MRenderNode* node);
+		void CalcSubtreeEnd();
 
 		friend class MRenderNode;
 	};
@@ -306,6 +306,7 @@ namespace Mui::Render
 		//绘制
 		void OnRender(MRenderCmd* render, void* data) override;
 		void OnRenderChildEnd(MRenderCmd* render, void* data) override;
+		bool GetRenderRect(_m_rect& rect) override;
 
 		struct MPaintParam
 		{
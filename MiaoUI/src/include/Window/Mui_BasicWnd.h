@@ -110,6 +110,42 @@ namespace Mui
 
 	namespace Window
 	{
+		/*窗口脏区域
+		 * 累积两帧之间的所有无效区域 合并后浪费的面积较小的矩形会被合并
+		 * 包含关系和边长对齐的相邻矩形总是合并 矩形过多时退化为外接矩形
+		 * 非线程安全 由调用方加锁
+		 */
+		class UIDirtyRegion
+		{
+		public:
+			//最多保留的矩形数量 超过后退化为外接矩形
+			static constexpr size_t MaxRects = 8;
+
+			//添加脏矩形 空矩形将被忽略
+			void Add(const _m_rect& rect);
+			//标记整个窗口为脏区域
+			void AddFull();
+
+			//是否没有脏区域
+			[[nodiscard]] bool IsEmpty() const { return !m_full && m_rects.empty(); }
+			//是否为整个窗口
+			[[nodiscard]] bool IsFull() const { return m_full; }
+
+			//获取所有脏矩形的外接矩形 整个窗口时返回{0}
+			[[nodiscard]] _m_rect GetBounds() const;
+			//获取合并后的脏矩形列表
+			[[nodiscard]] const std::vector<_m_rect>& GetRects() const { return m_rects; }
+
+			void Clear();
+			void Swap(UIDirtyRegion& region) noexcept;
+
+		private:
+			std::vector<_m_rect> m_rects;
+			bool m_full = false;
+
+			void Collapse();
+		};
+
 		class UIWindowBasic : public IWindow::UINativeWindow, MThreadT<std::recursive_mutex>
 		{
 		public:
@@ -128,6 +164,11 @@ namespace Mui
 			*/
 			virtual void UpdateLayout(MPCRect rect);
 
+			/*投递布局更新 不等待完成
+			* 用于没有调用方等待布局结果的场合 如异步解码完成和窗口尺寸改变
+			*/
+			void PostLayout();
+
 			/*更新显示
 			* @param rect - 更新区域 nullptr = 全部区域
 			*/
@@ -263,9 +304,14 @@ namespace Mui
 			*/
 			virtual bool EventProc(UINotifyEvent event, Ctrl::UIControl* contorl, _m_param param) = 0;
 
-			//呈现绘制结果
+			/*呈现绘制结果
+			* @param dirtyArea - 脏区域的外接矩形 IsPresentDirtyOnly为true时脏矩形之间的部分保留上一帧的内容 可以一次呈现
+			*/
 			virtual void Present(Render::MRenderCmd* render, const _m_rect_t<int>* dirtyArea) = 0;
 
+			//Present是否只呈现脏区域 为true时只绘制与脏矩形相交的控件
+			virtual bool IsPresentDirtyOnly() { return false; }
+
 			//初始化渲染器
 			virtual bool InitRender(Render::MRenderCmd* render) = 0;
 
@@ -302,11 +348,12 @@ namespace Mui
 
 			XML::MuiXML* m_xmlUI = nullptr;
 
-			//MQueue<_m_rect_t<int>> m_drawCmdList;					//绘制命令队列
-			Render::MRingQueue<_m_rect_t<int>> m_drawCmdList;
+			UIDirtyRegion m_dirtyRegion;							//待绘制的脏区域
+			std::mutex m_dirtyLock;
 			std::atomic_bool m_renderMode;					  		//是否为主动渲染模式
 																	
-			void RenderControlTree(const _m_rect_t<int>* dirtyArea);//渲染控件树
+			void RenderControlTree(const _m_rect_t<int>* dirtyArea, const std::vector<_m_rect>* dirtyRects = nullptr);//渲染控件树
+			void LayoutProc();//布局控件树 在渲染线程调用
 			void ThreadProc();										//独立窗口线程
 			void FreeCurMouseCtrl();								//释放当前鼠标控件
 
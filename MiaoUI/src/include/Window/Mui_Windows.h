@@ -102,6 +102,8 @@ namespace Mui::Window
 
 		void Present(Render::MRenderCmd* render, const _m_rect_t<int>* rcPaint) override;
 
+		bool IsPresentDirtyOnly() override;
+
 		bool InitRender(Render::MRenderCmd* render) override;
 
 	private:
@@ -160,7 +160,7 @@ namespace Mui::Ctrl
 		}
 		UILabel::OnPaintProc(param);
 		//图标绘制
-		if (attrib.dropIcon)
+		if (attrib.dropIcon && attrib.dropIcon->GetBitmap())
 		{
 			UIRect dragIcoPos = *param->destRect;
 			int frameHeight = dragIcoPos.GetHeight();
@@ -44,8 +44,8 @@ namespace Mui::Ctrl
 	UISize UIImgBox::GetImageSize() const
 	{
 		UISize size;
-		if (m_image)
-			size = m_image->GetBitmap()->GetSize();
+		if (const auto image = m_image ? m_image->GetBitmap() : nullptr)
+			size = image->GetSize();
 		return size;
 	}
 
@@ -131,7 +131,10 @@ namespace Mui::Ctrl
 		if (!m_image)
 			return;
 
+		//异步加载中
 		auto image = m_image->GetBitmap();
+		if (!image)
+			return;
 
 		UIRect m_DrawRect = *param->destRect;
 		const UISize m_Size = image->GetSize();
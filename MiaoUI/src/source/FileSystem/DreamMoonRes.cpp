@@ -26,10 +26,25 @@
 #define wsize 2
 #define clsnameMax 30
 
+#if MUI_CFG_ENABLE_V2DMRES
+//v2格式魔数 "DMR2"
+#define DMResV2Magic 0x32524D44
+//v2格式资源数据对齐尺寸
+#define DMResV2Align 4096
+//v2格式资源标志 块资源模式
+#define DMResV2Block 0x1
+//v2格式资源标志 压缩存储
+#define DMResV2Compress 0x2
+#endif
+
 #if MUI_CFG_ENABLE_CRYPTOPP
 #define DMRES_USE_CRYPTOPP
 #endif
 
+#if MUI_CFG_ENABLE_V2DMRES && MUI_CFG_ENABLE_LZ4LIB
+#define DMRES_USE_LZ4LIB
+#endif
+
 #ifdef DMRES_USE_CRYPTOPP
 #include <cryptlib.h>
 #include <filters.h>
@@ -41,9 +56,17 @@
 #include <MiaoUI\src\source\ThirdParty\aes256.h>
 #include <MiaoUI\src\source\ThirdParty\picosha2.h>
 #endif // DMRES_USE_CRYPTOPP
+#ifdef DMRES_USE_LZ4LIB
+#include <lz4.h>
+#else
+#include <MiaoUI\src\source\ThirdParty\lz4block.h>
+#endif // DMRES_USE_LZ4LIB
 
 #ifdef __ANDROID__
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <android/log.h>
 #include "errno.h"
 #endif
@@ -57,26 +80,26 @@ namespace Mui {
 
 	bool DMResources::LoadResource(std::wstring resfiles, bool mem)
 	{
-		if (m_files || m_resource.data)
+		if (m_source || m_resource.data)
 			return false;
 		if (mem) {
 			m_resource = ReadFiles(resfiles);
 			if (!m_resource.data)
 				return false;
+			m_filePath = resfiles;
 			bool ret = LoadResList(!mem);
 			if (!ret)
+			{
+				//解析失败时资源数据未被释放
+				free(m_resource.data);
 				CloseResource();
+			}
 			return ret;
 		}
 		else {
-#ifdef _WIN32
-			m_files = _wfsopen(resfiles.c_str(), L"rb", _SH_DENYNO);
-			//_wfopen_s(&m_files, resfiles.c_str(), L"rb");
-#endif // _WIN32
-#ifdef __ANDROID__
-			m_files = fopen((char*)M_WStringToString(resfiles).c_str(), "rb");
-#endif // __ANDROID__
-			if (m_files) {
+			m_filePath = resfiles;
+			m_source = DMResSource::Open(resfiles);
+			if (m_source) {
 				bool ret = LoadResList(!mem);
 				if (!ret)
 					CloseResource();
@@ -86,6 +109,20 @@ namespace Mui {
 		return false;
 	}
 
+	bool DMResources::LoadResourceMapped(std::wstring resfiles)
+	{
+		if (m_source || m_resource.data)
+			return false;
+		m_source = DMResSource::Map(resfiles);
+		if (!m_source)
+			return false;
+		m_resource = { (_m_byte*)m_source->View(), (_m_size)m_source->Size() };
+		bool ret = LoadResList();
+		if (!ret)
+			CloseResource();
+		return ret;
+	}
+
 #ifdef _WIN32
 
 	UIResource DMResources::ReadPEResource(DWORD resID, LPCWSTR type)
@@ -125,159 +162,154 @@ namespace Mui {
 		m_resource.data = (_m_byte*)malloc(memres.size);
 
 		memcpy(m_resource.data, memres.data, memres.size);
-		return LoadResList();
+		bool ret = LoadResList();
+		if (!ret)
+		{
+			free(m_resource.data);
+			CloseResource();
+		}
+		return ret;
 	}
 
 	_m_size DMResources::GetResourceCount()
 	{
-		return (_m_size)dmResList.size();
+		const auto snapshot = GetSnapshot();
+		return snapshot ? (_m_size)snapshot->list.size() : 0;
 	}
 
 	DMResKey DMResources::ReadResource(std::wstring resname, std::wstring reskey, ResType type)
 	{
 		DMResKey key;
-		mx.lock();
-		for (auto item : dmResList)
+		//快照持有资源项数据 读取期间即使资源被修改也保持有效
+		const auto snapshot = GetSnapshot();
+		const DMResItem* item = snapshot ? snapshot->Find(resname) : nullptr;
+		if (!item)
+			return key;
+		//压缩资源按块读取和解码 文件模式和内存模式相同
+		const bool readData = type == AllRes || type == DataRes;
+		if (readData && item->compress)
 		{
-			if (item.resname == resname)
-			{
-				if (m_files)
-				{
-					if (type == AllRes || type == DataRes) {
-						if (item.resPos.second != 0)
-						{
-							item.res.data = new _m_byte[item.resPos.second];
-							fseek(m_files, item.resPos.first, SEEK_SET);
-							fread(item.res.data, 1, item.resPos.second, m_files);
-							int err = ferror(m_files);
-							key.res = Deciphering(item.res, reskey);
-							delete[] item.res.data;
-						}
-					}
-					if (type == AllRes || type == StringRes) {
-						if (item.strPos.second != 0)
-						{
-							char16_t* str = new char16_t[item.strPos.second];
-							fseek(m_files, item.strPos.first, SEEK_SET);
-							fread(str, 1, item.strPos.second * wsize, m_files);
-							key.resText = DecipheringText({ (_m_byte*)str, item.strPos.second }, reskey);
-							delete[] str;
-						}
-					}
-				}
-				else
-				{
-					if (type == AllRes || type == DataRes) {
-						if (item.res.data)
-							key.res = Deciphering(item.res, reskey);
-					}
-					if (type == AllRes || type == StringRes) {
-						if (item.text.data)
-							key.resText = DecipheringText(item.text, reskey);
-					}
-				}
-				break;
-			}
+			UIResource data(new _m_byte[item->rawSize], item->rawSize);
+			if (DecCompressed(*item, reskey, 0, item->rawSize, data.data))
+				key.res = data;
+			else
+				data.Release();
 		}
-		mx.unlock();
+		//文件模式下新增和修改的资源位于内存中 其他资源从文件读取
+		std::vector<_m_byte> buffer;
+		UIResource data;
+		if (readData && !item->compress && GetItemRaw(*item, false, buffer, data) && data.data)
+			key.res = item->block ? DecBlockResource(data, reskey, item->blockSize) : Deciphering(data, reskey);
+		if ((type == AllRes || type == StringRes) && GetItemRaw(*item, true, buffer, data) && data.data)
+			key.resText = DecipheringText(data, reskey);
 		return key;
 	}
 
 	UIResource DMResources::ReadResourceBlock(std::wstring resname, std::wstring reskey, _m_uint offset, _m_size len, _m_size* retlen)
 	{
 		UIResource res;
-		mx.lock();
-		for (auto item : dmResList)
+		const auto snapshot = GetSnapshot();
+		const DMResItem* item = snapshot ? snapshot->Find(resname) : nullptr;
+		if (!item)
+			return res;
+		//压缩资源的偏移和长度是原数据上的位置
+		if (item->compress)
 		{
-			if (item.resname == resname)
+			if (offset > item->rawSize)
+				return res;
+			const _m_size readsize = Helper::M_MIN(len, (_m_size)(item->rawSize - offset));
+			UIResource data(new _m_byte[readsize], readsize);
+			if (DecCompressed(*item, reskey, offset, readsize, data.data))
 			{
-				if (m_files)
-				{
-					if (item.resPos.second != 0)
-					{
-						_m_size readsize = len;
-						//偏移量超过数据大小 返回空
-						if (offset > item.resPos.second) {
-							mx.unlock();
-							return res;
-						}
-						//偏移量+要读取的数据大于剩余数据
-						else if (offset + len > item.resPos.second)
-							readsize = item.resPos.second - offset;//取可读的数据
-
-						item.res.data = new _m_byte[readsize];
-						fseek(m_files, item.resPos.first + offset, SEEK_SET);
-						_m_size read = (_m_size)fread(item.res.data, 1, readsize, m_files);
-						int err = ferror(m_files);
-						item.res.size = read;
-						res = Deciphering(item.res, reskey);
-						delete[] item.res.data;
-						if (retlen)
-							*retlen = read;
-					}
-				}
-				else
-				{
-					if (item.res.data) {
-						_m_size readsize = len;
-						if (offset > item.res.size) {
-							mx.unlock();
-							return res;
-						}
-						else if (offset + len > item.res.size)
-							readsize = item.res.size - offset;
-						item.res.data += offset;
-						item.res.size = readsize;
-						res = Deciphering(item.res, reskey);
-						if (retlen)
-							*retlen = readsize;
-					}
-				}
-				break;
+				res = data;
+				if (retlen)
+					*retlen = readsize;
+			}
+			else
+				data.Release();
+			return res;
+		}
+		if (item->res.size != 0)
+		{
+			//偏移量超过数据大小 返回空
+			if (offset > item->res.size)
+				return res;
+			//偏移量+要读取的数据大于剩余数据时 取可读的数据
+			const _m_size readsize = Helper::M_MIN(len, item->res.size - offset);
+			std::vector<_m_byte> buffer;
+			if (const _m_byte* data = ReadItemRange(*item, offset, readsize, buffer))
+			{
+				res = Deciphering({ (_m_byte*)data, readsize }, reskey);
+				if (retlen)
+					*retlen = readsize;
 			}
 		}
-		mx.unlock();
 		return res;
 	}
 
 	_m_size DMResources::ReadResourceSize(std::wstring resname, ResType type)
 	{
-		std::lock_guard<std::mutex> lock(mx);
-		for (auto item : dmResList)
-		{
-			if (item.resname == resname)
-			{
-				if (m_files)
-				{
-					if (type == DataRes)
-						return item.resPos.second;
-					else if (type == StringRes && item.strPos.second)
-						return (_m_size)((double)item.strPos.second / (double)sizeof(char16_t));
-				}
-				else
-				{
-					if (type == DataRes)
-						return item.res.size;
-					else if (type == StringRes && item.text.size)
-						return (_m_size)((double)item.text.size / (double)sizeof(char16_t));
-				}
-			}
-		}
+		const auto snapshot = GetSnapshot();
+		const DMResItem* item = snapshot ? snapshot->Find(resname) : nullptr;
+		if (!item)
+			return 0;
+		if (type == DataRes && item->compress)
+			return item->rawSize;
+		//文件模式下未加载的资源也记录了尺寸
+		if (type == DataRes)
+			return item->res.size;
+		else if (type == StringRes && item->text.size)
+			return (_m_size)((double)item->text.size / (double)sizeof(char16_t));
 		return 0;
 	}
 
 	bool DMResources::ReadResBlockInfo(std::wstring resname, _m_size* blocksize)
 	{
-		for (auto item : dmResList)
+		const auto snapshot = GetSnapshot();
+		const DMResItem* item = snapshot ? snapshot->Find(resname) : nullptr;
+		if (!item)
+			return false;
+		if (blocksize)
+			*blocksize = item->blockSize;
+		return item->block;
+	}
+
+	DMResStreamPtr DMResources::OpenStream(std::wstring resname, std::wstring reskey)
+	{
+		const auto snapshot = GetSnapshot();
+		const DMResItem* item = snapshot ? snapshot->Find(resname) : nullptr;
+		if (!item)
+			return nullptr;
+
+		DMResStreamPtr stream = new DMResStream();
+		stream->m_schedule = GetKeySchedule(reskey);
+		stream->m_block = item->block && item->blockSize;
+		stream->m_unit = stream->m_block ? item->blockSize : DMResStream::unitSize;
+		//数据源在映射模式下保持m_data有效
+		stream->m_source = item->source;
+		if (item->source && !item->res.data)
 		{
-			if (item.resname == resname)
-			{
-				if (blocksize)
-					*blocksize = item.blockSize;
-				return item.block;
-			}
+			stream->m_dataPos = item->resPos.first;
+			stream->m_size = item->resPos.second;
 		}
-		return false;
+		else
+		{
+			stream->m_data = item->res.data;
+			stream->m_buffer = item->resBuffer;
+			stream->m_size = item->res.size;
+		}
+		if (item->compress)
+		{
+			//压缩资源以块为单位解码 非块模式将整个资源作为一个单元
+			stream->m_compress = true;
+			stream->m_stored = item->res.size;
+			stream->m_size = item->rawSize;
+			if (!stream->m_block)
+				stream->m_unit = Helper::M_MAX((_m_size)item->rawSize, (_m_size)1);
+			else if (!ReadChunkTable(*item, stream->m_schedule, stream->m_chunks))
+				return nullptr;
+		}
+		return stream;
 	}
 
 	bool DMResources::EnumResourceName(std::vector<std::wstring>& nameList)
@@ -285,12 +317,14 @@ namespace Mui {
 		nameList.clear();
 		if (!m_resource.data)
 			return false;
-		mx.lock();
-		for (auto item : dmResList)
+		const auto snapshot = GetSnapshot();
+		if (!snapshot)
+			return true;
+		nameList.reserve(snapshot->list.size());
+		for (const auto& item : snapshot->list)
 		{
 			nameList.push_back(item.resname);
 		}
-		mx.unlock();
 		return true;
 	}
 
@@ -315,51 +349,70 @@ namespace Mui {
 
 	bool DMResources::AddResource(DMResKey res, std::wstring resname, std::wstring reskey, DMEncBlockCallback callback)
 	{
-		if (!m_resource.data)
+		if (!m_resource.data || IsMapped())
+			return false;
+		if (const auto snapshot = GetSnapshot(); snapshot && snapshot->Find(resname))
 			return false;
+
 		DMResItem item;
 		item.resname = resname;
+		//使用回调的块资源在后台编码 添加到列表后再开始
+		bool encodeLater = false;
 
 		if (res.res.data && res.res.size)
 		{
-			if (res.block) 
+#if MUI_CFG_ENABLE_V2DMRES
+			item.compress = res.compress;
+			item.rawSize = (_m_uint)res.res.size;
+#endif
+			//块尺寸为0的块资源按非块模式压缩
+			const bool chunked = res.block && res.blockSize;
+			if (res.block)
 			{
-				if (callback.callback) 
-				{
-					if (!res.resText.empty())
-						item.text = EncipheringText(res.resText, reskey);
-					mx.lock();
-					dmResList.push_back(item);
-					mx.unlock();
-					EncBlockResource(res.res, resname, reskey, (_m_uint)res.blockSize, callback);
-					return true;
-				} else
-					item.res = EncBlockResource(res.res, resname, reskey, (_m_uint)res.blockSize, callback);
+				item.block = true;
+				item.blockSize = (_m_uint)res.blockSize;
 			}
+			if (item.compress && !chunked)
+				SetItemData(item.res, item.resBuffer, EncodeChunk(res.res, GetKeySchedule(reskey), item.compress));
+			else if (res.block && callback.callback)
+				encodeLater = true;
+			else if (res.block)
+				SetItemData(item.res, item.resBuffer, EncBlockResource(res.res, resname, reskey, (_m_uint)res.blockSize, callback, item.compress));
 			else
-				item.res = Enciphering(res.res, reskey);
+				SetItemData(item.res, item.resBuffer, Enciphering(res.res, reskey));
 		}
 		if (!res.resText.empty())
-			item.text = EncipheringText(res.resText, reskey);
+			SetItemData(item.text, item.textBuffer, EncipheringText(res.resText, reskey));
 
-		dmResList.push_back(item);
-		return true;
+		//item在发布时被移动 之后不能再访问
+		const bool compress = item.compress;
+		const bool ret = ModifyResList([&](DMResSnapshot& list)
+		{
+			if (!list.index.emplace(resname, list.list.size()).second)
+				return false;
+			list.list.push_back(std::move(item));
+			return true;
+		});
+		if (ret && encodeLater)
+			EncBlockResource(res.res, resname, reskey, (_m_uint)res.blockSize, callback, compress);
+		return ret;
 	}
 
 	bool DMResources::RenameResource(std::wstring resname, std::wstring newname)
 	{
-		if (!m_resource.data)
+		if (!m_resource.data || IsMapped())
 			return false;
-		std::lock_guard<std::mutex> lock(mx);
-		for (size_t i = 0; i < dmResList.size(); i++)
+		return ModifyResList([&](DMResSnapshot& list)
 		{
-			if (dmResList[i].resname == resname)
-			{
-				dmResList[i].resname = newname;
-				return true;
-			}
-		}
-		return false;
+			auto iter = list.index.find(resname);
+			if (iter == list.index.end() || list.index.find(newname) != list.index.end())
+				return false;
+			const size_t index = iter->second;
+			list.index.erase(iter);
+			list.index[newname] = index;
+			list.list[index].resname = newname;
+			return true;
+		});
 	}
 
 	void DMResources::RenameClassName(std::wstring newname)
@@ -370,83 +423,208 @@ namespace Mui {
 	bool DMResources::ChangeResource(std::wstring resname, DMResKey newres, std::wstring reskey, ResType type,
 		DMEncBlockCallback callback)
 	{
-		if (!m_resource.data)
+		if (!m_resource.data || IsMapped())
 			return false;
-		for (size_t i = 0; i < dmResList.size(); i++)
-		{
-			if (dmResList[i].resname == resname)
-			{
-				//释放原始资源
-				if (type == AllRes || type == DataRes) {
-					if (dmResList[i].res.data && dmResList[i].res.size)
-						dmResList[i].res.Release();
-
-					if (newres.res.data && newres.res.size) {
-						dmResList[i].block = newres.block;
-						if (newres.block) {
-							dmResList[i].blockSize = newres.blockSize;
-							dmResList[i].res = EncBlockResource(newres.res, resname, reskey, newres.blockSize, callback);
-						}
-						else {
-							dmResList[i].blockSize = 0;
-							dmResList[i].res = Enciphering(newres.res, reskey);
-						}
-					}
-				}
-				if (type == AllRes || type == StringRes) {
-					if (dmResList[i].text.data && dmResList[i].text.size)
-						dmResList[i].text.Release();
+		if (const auto snapshot = GetSnapshot(); !snapshot || !snapshot->Find(resname))
+			return false;
+
+		const bool changeData = type == AllRes || type == DataRes;
+		const bool changeText = type == AllRes || type == StringRes;
+
+		//先在列表外完成编码 使用回调的块资源在列表更新后再开始后台编码
+		UIResource data;
+		UIResource text;
+		bool encodeLater = false;
+		bool compress = false;
+		if (changeData && newres.res.data && newres.res.size) {
+#if MUI_CFG_ENABLE_V2DMRES
+			compress = newres.compress;
+#endif
+			if (compress && !(newres.block && newres.blockSize))
+				data = EncodeChunk(newres.res, GetKeySchedule(reskey), compress);
+			else if (newres.block && callback.callback)
+				encodeLater = true;
+			else if (newres.block)
+				data = EncBlockResource(newres.res, resname, reskey, newres.blockSize, callback, compress);
+			else
+				data = Enciphering(newres.res, reskey);
+		}
+		if (changeText && newres.resText != L"")
+			text = EncipheringText(newres.resText, reskey);
 
-					if (newres.resText != L"")
-						dmResList[i].text = EncipheringText(newres.resText, reskey);
+		const bool ret = ModifyResList([&](DMResSnapshot& list)
+		{
+			auto iter = list.index.find(resname);
+			if (iter == list.index.end())
+				return false;
+			DMResItem& item = list.list[iter->second];
+			//替换原始资源 原始数据在不再被引用后释放
+			if (changeData) {
+				SetItemData(item.res, item.resBuffer, data);
+				if (newres.res.data && newres.res.size) {
+					item.block = newres.block;
+					item.blockSize = newres.block ? (_m_uint)newres.blockSize : 0;
 				}
-				return true;
+				item.compress = compress;
+				item.rawSize = compress ? (_m_uint)newres.res.size : 0;
+			}
+			if (changeText)
+				SetItemData(item.text, item.textBuffer, text);
+			//内容已改变 需要重新保存 文件中的原位置不再使用
+			if (changeData) {
+				item.resPos = std::make_pair(0, 0);
+				item.resStored = false;
+			}
+			if (changeText) {
+				item.strPos = std::make_pair(0, 0);
+				item.textStored = false;
 			}
+			return true;
+		});
+		if (!ret)
+		{
+			data.Release();
+			text.Release();
+			return false;
 		}
-		return false;
+		if (encodeLater)
+			EncBlockResource(newres.res, resname, reskey, newres.blockSize, callback, compress);
+		return true;
 	}
 
 	bool DMResources::DeleteResource(std::wstring resname)
 	{
-		if (!m_resource.data)
+		if (!m_resource.data || IsMapped())
 			return false;
-		std::lock_guard<std::mutex> lock(mx);
-		for (size_t i = 0; i < dmResList.size(); i++)
+		return ModifyResList([&](DMResSnapshot& list)
 		{
-			if (dmResList[i].resname == resname)
-			{
-				//释放资源
-				if (dmResList[i].res.data && dmResList[i].res.size)
-					dmResList[i].res.Release();
-				if (dmResList[i].text.data && dmResList[i].text.size)
-					dmResList[i].text.Release();
+			auto iter = list.index.find(resname);
+			if (iter == list.index.end())
+				return false;
 
-				dmResList.erase(dmResList.begin() + i);
-				return true;
+			const size_t i = iter->second;
+			list.list.erase(list.list.begin() + i);
+			list.index.erase(iter);
+			//后续项目下标前移
+			for (auto& index : list.index)
+			{
+				if (index.second > i)
+					index.second--;
 			}
-		}
+			return true;
+		});
+	}
+
+	bool DMResources::SaveResource(std::wstring filename, bool v2)
+	{
+		const auto snapshot = GetSnapshot();
+		if (!snapshot)
+			return false;
+		//文件模式下资源数据仍从原文件读取 不能直接覆盖
+		if (!m_filePath.empty() && filename == m_filePath)
+			return Compact();
+
+#if MUI_CFG_ENABLE_V2DMRES
+		//v1格式不能记录压缩存储
+		if (!v2 && std::any_of(snapshot->list.begin(), snapshot->list.end(), [](const DMResItem& item) { return item.compress; }))
+			return false;
+#else
+		v2 = false;
+#endif
+
+		FILE* file = OpenWriteFile(filename, false);
+		if (!file)
+			return false;
+
+#if MUI_CFG_ENABLE_V2DMRES
+		const bool ret = v2 ? WriteResListV2(file, *snapshot) : WriteResListV1(file, *snapshot);
+#else
+		const bool ret = WriteResListV1(file, *snapshot);
+#endif
+		if (fclose(file) == 0)
+			return ret;
+
 		return false;
 	}
 
-	bool DMResources::SaveResource(std::wstring filename)
+	bool DMResources::Compact()
 	{
-		m_resheader.rescount = (_m_uint)dmResList.size();
-		m_resheader.ressign = L"DreamMoonResFile";
-		m_resheader.resver = DMResVer;
+		if (m_filePath.empty() || IsMapped() || !GetSnapshot())
+			return false;
+		const std::wstring path = m_filePath;
+		const std::wstring temp = path + L".tmp";
+		const bool mem = !m_source;
+		//先完整写入临时文件 失败时原文件不受影响 保持加载的文件格式
+		if (!SaveResource(temp, m_v2File))
+		{
+#ifdef _WIN32
+			_wremove(temp.c_str());
+#endif
+#ifdef __ANDROID__
+			remove(Helper::M_WStringToString(temp).c_str());
+#endif
+			return false;
+		}
+		//关闭后替换原文件 仍在使用的快照和数据流继续读取被替换的原文件
+		CloseResource();
+#ifdef _WIN32
+		const bool ret = MoveFileExW(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+		if (!ret)
+			_wremove(temp.c_str());
+#endif
+#ifdef __ANDROID__
+		const bool ret = rename(Helper::M_WStringToString(temp).c_str(), Helper::M_WStringToString(path).c_str()) == 0;
+		if (!ret)
+			remove(Helper::M_WStringToString(temp).c_str());
+#endif
+		//替换失败时重新加载原文件
+		return LoadResource(path, mem) && ret;
+	}
 
-		FILE* file;
+	FILE* DMResources::OpenWriteFile(const std::wstring& path, bool append)
+	{
+		FILE* file = nullptr;
 #ifdef _WIN32
-		_wfopen_s(&file, filename.c_str(), L"wb");
-#else
+		//追加时资源文件可能正以文件模式打开
+		if (append)
+			file = _wfsopen(path.c_str(), L"r+b", _SH_DENYNO);
+		else
+			_wfopen_s(&file, path.c_str(), L"wb");
+#endif
+#ifdef __ANDROID__
+		file = fopen(Helper::M_WStringToString(path).c_str(), append ? "r+b" : "wb+");
+#endif
+		return file;
+	}
+
+	bool DMResources::SeekFile(FILE* file, _m_ulong64 pos, int origin)
+	{
+		//使用64位位置 long在Windows上只有32位
+#ifdef _WIN32
+		return _fseeki64(file, (_m_long64)pos, origin) == 0;
+#endif
 #ifdef __ANDROID__
-		char* path = (char *)M_WStringToString(filename).c_str();
+		return fseeko(file, (off_t)pos, origin) == 0;
+#endif
+		return false;
+	}
 
-		file = fopen(path, "wb+");
-        //__android_log_print(ANDROID_LOG_ERROR, "ERRON:", "%d", errno);
+	_m_long64 DMResources::TellFile(FILE* file)
+	{
+#ifdef _WIN32
+		return _ftelli64(file);
 #endif
+#ifdef __ANDROID__
+		return (_m_long64)ftello(file);
 #endif
-		if (!file)
-			return false;
+		return -1;
+	}
+
+	bool DMResources::WriteResListV1(FILE* file, const DMResSnapshot& snapshot)
+	{
+		m_resheader.rescount = (_m_uint)snapshot.list.size();
+		m_resheader.ressign = L"DreamMoonResFile";
+		m_resheader.resver = DMResVer;
 
 		/*写文件头*/
 
@@ -457,265 +635,794 @@ namespace Mui {
 		fwrite(classname.data, 1, strLen, file);
 		classname.Release();
 		//写入签名长度和签名
-		strLen = (_m_uint)m_resheader.ressign.length();
+		std::vector<char16_t> str;
+		AppendUTF16(m_resheader.ressign, str);
+		strLen = (_m_uint)str.size();
 		fwrite(&strLen, 1, sizeof(strLen), file);
-#ifdef _WIN32
-        fwrite(m_resheader.ressign.data(), 1, m_resheader.ressign.length() * wsize, file);
-#endif
-#ifdef __ANDROID__
-        char16_t * str = wchar32Towchar16((wchar_t *)m_resheader.ressign.data(), m_resheader.ressign.length());
-        fwrite(str, 1, m_resheader.ressign.length() * wsize, file);
-        delete[] str;
-#endif
+		fwrite(str.data(), 1, strLen * wsize, file);
 		//写入版本号长度和版本号
-		strLen = (_m_uint)m_resheader.resver.length();
+		str.clear();
+		AppendUTF16(m_resheader.resver, str);
+		strLen = (_m_uint)str.size();
 		fwrite(&strLen, 1, sizeof(strLen), file);
-#ifdef _WIN32
-        fwrite(m_resheader.resver.data(), 1, m_resheader.resver.length() * wsize, file);
-#endif
-#ifdef __ANDROID__
-        str = wchar32Towchar16((wchar_t *)m_resheader.resver.data(), m_resheader.resver.length());
-        fwrite(str, 1, m_resheader.resver.length() * wsize, file);
-        delete[] str;
-#endif
+		fwrite(str.data(), 1, strLen * wsize, file);
 		//写入资源数量
 		fwrite(&m_resheader.rescount, 1, sizeof(m_resheader.rescount), file);
 
 		/*写资源列表数据*/
-		for (auto item : dmResList)
+		std::vector<_m_byte> buffer;
+		for (const auto& item : snapshot.list)
 		{
 			//写资源长度和资源
-			_m_uint size = (_m_uint)item.res.size;
+			UIResource data;
+			if (!GetItemRaw(item, false, buffer, data))
+				return false;
+			_m_uint size = (_m_uint)data.size;
 			fwrite(&size, 1, sizeof(size), file);
 			if (size != 0)
-				fwrite(item.res.data, 1, item.res.size, file);
+				fwrite(data.data, 1, data.size, file);
 			//写文本数据长度和数据
-			size = (_m_uint)item.text.size;
+			if (!GetItemRaw(item, true, buffer, data))
+				return false;
+			size = (_m_uint)data.size;
 			fwrite(&size, 1, sizeof(size), file);
 			if (size != 0)
-				fwrite(item.text.data, 1, item.text.size, file);
+				fwrite(data.data, 1, data.size, file);
 			//写资源名文本长度
-			size = (_m_uint)item.resname.length();
+			str.clear();
+			AppendUTF16(item.resname, str);
+			size = (_m_uint)str.size();
 			fwrite(&size, 1, sizeof(size), file);
-			if (size != 0) {
-#ifdef _WIN32
-                fwrite(item.resname.data(), 1, size * wsize, file);
-#endif
-#ifdef __ANDROID__
-                str = wchar32Towchar16((wchar_t *)item.resname.data(), strLen);
-                fwrite(str, 1, strLen * wsize, file);
-                delete[] str;
-#endif
-            }
+			if (size != 0)
+				fwrite(str.data(), 1, size * wsize, file);
 			//写块资源长度和数据
 			size = item.blockSize;
 			fwrite(&size, 1, sizeof(size), file);
 		}
-
-		if (fclose(file) == 0)
-			return true;
-
-		return false;
+		return ferror(file) == 0;
 	}
 
-	bool DMResources::LoadResList(bool files)
+	/*资源列表读取游标
+	* 内存和映射模式直接读取数据 文件模式按大块缓冲读取 跳过资源数据时不产生读取
+	* 所有读取都会检查边界 越界时返回失败
+	*/
+	class DMResources::DMResCursor
 	{
-		//当前读取内存位置
-		_m_ulong curMemPos = 0;
-		//读取类名二进制字符串长度
-		_m_uint strLen = 0;
-		if (files) {
-			fseek(m_files, 0, SEEK_SET);
-			fread(&strLen, 1, sizeof(_m_uint), m_files);
-		} else
-			memcpy(&strLen, m_resource.data, sizeof(_m_uint));
-		if (strLen > clsnameMax)
-			return false;
-		//读取类名
-		char16_t* str = (char16_t*)new char16_t[strLen + 1];
-		curMemPos = sizeof(_m_uint);//一个UINT数据记录二进制字节长度
-		if (files) {
-			fseek(m_files, curMemPos, SEEK_SET);
-			fread(str, 1, strLen * wsize, m_files);
-		} else
-			memcpy(str, m_resource.data + curMemPos, strLen * wsize);
-		str[strLen] = '\0';//添加字符串结尾
-		m_resheader.classname = DecipheringText({ (_m_byte*)str, strLen }, L"DMResFile");
-		delete[] str;
-		//读取签名长度
-		curMemPos += strLen;//原位置加上原数据长度 后面是存签名长度的UINT类型
-		strLen = 0;
-		if (files) {
-			fseek(m_files, curMemPos, SEEK_SET);
-			fread(&strLen, 1, sizeof(_m_uint), m_files);
-		}
-		else
-			memcpy(&strLen, m_resource.data + curMemPos, sizeof(_m_uint));
-		//读取签名
-		str = new char16_t[strLen + 1];
-		curMemPos += sizeof(_m_uint);//过UINT数据后是签名字符串数据
-		if (files) {
-			fseek(m_files, curMemPos, SEEK_SET);
-			fread(str, 1, strLen * wsize, m_files);
-		}
-		else
-			memcpy(str, m_resource.data + curMemPos, strLen * wsize);
-		str[strLen] = '\0';//添加字符串结尾
-		m_resheader.ressign = wchar16Towchar32(str, strLen);
-		delete[] str;
-		//读取版本号长度
-		curMemPos += strLen * wsize;//上一个位置加上字符串数据长度 后面是存版本号长度的UINT类型
-		strLen = 0;
-		if (files) {
-			fseek(m_files, curMemPos, SEEK_SET);
-			fread(&strLen, 1, sizeof(_m_uint), m_files);
-		}
-		else
-			memcpy(&strLen, m_resource.data + curMemPos, sizeof(_m_uint));
-		//读取版本号
-		str = new char16_t[strLen * wsize];
-		curMemPos += sizeof(_m_uint);//过UINT数据后是签名字符串数据
-		if (files) {
-			fseek(m_files, curMemPos, SEEK_SET);
-			fread(str, 1, strLen * wsize, m_files);
-		}
-		else
-			memcpy(str, m_resource.data + curMemPos, strLen * wsize);
-		str[strLen] = '\0';//添加字符串结尾
-		m_resheader.resver = wchar16Towchar32(str, strLen);
-		delete[] str;
-		//读取资源数量
-		curMemPos += strLen * wsize;
-		strLen = 0;
-		if (files) {
-			fseek(m_files, curMemPos, SEEK_SET);
-			fread(&strLen, 1, sizeof(_m_uint), m_files);
-		}
-		else
-			memcpy(&strLen, m_resource.data + curMemPos, sizeof(_m_uint));
-		m_resheader.rescount = strLen;
+	public:
+		DMResCursor(const _m_byte* data, _m_size size) : m_data(data), m_size(size) {}
+		DMResCursor(const DMResSource* source, _m_size size) : m_source(source), m_size(size) {}
 
-		if (m_resheader.classname == L""
-			|| !m_resheader.rescount || m_resheader.ressign == L""
-			|| m_resheader.resver == L"")
-			return false;
-		else {
-			/*读取资源列表数据*/
-			_m_uint dataLen = 0;
-			curMemPos += sizeof(_m_uint);//过资源数量后 地址是资源列表的开始
-			for (size_t i = 0; i < m_resheader.rescount; i++)
+		//读取len字节 返回的指针在下次读取前有效 越界返回nullptr
+		const _m_byte* Read(_m_size len)
+		{
+			if (len > m_size - m_pos)
+				return nullptr;
+			const _m_byte* ret = nullptr;
+			if (m_data)
+				ret = m_data + m_pos;
+			else
 			{
-				/*数据资源*/
-				UIResource data;
-				DMResItem item;
-				//读取资源数据长度
-				dataLen = 0;
-				if (files)
+				if (m_pos < m_bufPos || m_pos + len > m_bufPos + m_bufLen)
 				{
-					fseek(m_files, curMemPos, SEEK_SET);
-					fread(&dataLen, 1, sizeof(_m_uint), m_files);
-				} else
-					memcpy(&dataLen, m_resource.data + curMemPos, sizeof(_m_uint));
-				curMemPos += sizeof(_m_uint);//过数据长度 地址是数据开始位置
-				data.size = dataLen;
-				if (dataLen != 0 && !files)
-				{
-					_m_byte* res = new _m_byte[dataLen];
-					//读取数据
-					memcpy(res, m_resource.data + curMemPos, data.size);
-					data.data = res;
+					//缓冲区外的数据 从当前位置重新填充 单次读取超过缓冲区尺寸时扩大缓冲区
+					const _m_size fill = Helper::M_MIN(Helper::M_MAX(len, bufferSize), m_size - m_pos);
+					if (m_buffer.size() < fill)
+						m_buffer.resize((size_t)fill);
+					if (!m_source->ReadAt(m_pos, m_buffer.data(), fill))
+						return nullptr;
+					m_bufPos = m_pos;
+					m_bufLen = fill;
 				}
-				item.res = data;
-				item.resPos = std::make_pair(curMemPos, (_m_uint)data.size);
+				ret = m_buffer.data() + (m_pos - m_bufPos);
+			}
+			m_pos += len;
+			return ret;
+		}
 
-				/*文本资源*/
-				curMemPos += (_m_ulong)data.size;//文本数据长度地址
-				dataLen = 0;
-				if (files)
-				{
-					fseek(m_files, curMemPos, SEEK_SET);
-					fread(&dataLen, 1, sizeof(_m_uint), m_files);
-				}
-				else
-					memcpy(&dataLen, m_resource.data + curMemPos, sizeof(_m_uint));
-				curMemPos += sizeof(_m_uint);
-				UIResource dataText;
-				dataText.size = dataLen;
-				if (dataLen != 0 && !files)
-				{
-					_m_byte* res = new _m_byte[dataLen];
-					//读取数据
-					memcpy(res, m_resource.data + curMemPos, dataText.size);
-					dataText.data = res;
-				}
-				item.text = dataText;
-				item.strPos = std::make_pair(curMemPos, (_m_uint)dataText.size);
-
-				/*资源名*/
-				curMemPos += (_m_ulong)dataText.size;
-
-				dataLen = 0;
-				if (files) {
-					fseek(m_files, curMemPos, SEEK_SET);
-					fread(&dataLen, 1, sizeof(_m_uint), m_files);
-				} else
-					memcpy(&dataLen, m_resource.data + curMemPos, sizeof(_m_uint));
-				curMemPos += sizeof(_m_uint);
-				if (dataLen != 0)
-				{
-					char16_t* str = new char16_t[dataLen + 1];
-					if (files) {
-						fseek(m_files, curMemPos, SEEK_SET);
-						fread(str, 1, dataLen * wsize, m_files);
-					} else
-						memcpy(str, m_resource.data + curMemPos, dataLen * wsize);
-					str[dataLen] = '\0';//添加字符串结尾
-					item.resname = wchar16Towchar32(str, dataLen);
-					delete[] str;
-				}
-				curMemPos += dataLen * wsize;//过文本数据长度后是块尺寸
+		bool ReadUInt(_m_uint& dst)
+		{
+			const _m_byte* data = Read(sizeof(_m_uint));
+			if (data)
+				memcpy(&dst, data, sizeof(_m_uint));
+			return data != nullptr;
+		}
 
-				/*块信息*/
-				dataLen = 0;
-				if (files) {
-					fseek(m_files, curMemPos, SEEK_SET);
-					fread(&dataLen, 1, sizeof(_m_uint), m_files);
-				}
-				else
-					memcpy(&dataLen, m_resource.data + curMemPos, sizeof(_m_uint));
+		//读取len个字符的UTF-16字符串
+		bool ReadString(_m_uint len, std::wstring& dst)
+		{
+			const _m_byte* data = Read((_m_size)len * wsize);
+			if (data)
+				dst = wchar16Towchar32((const char16_t*)data, len);
+			return data != nullptr;
+		}
 
-				if (dataLen) {
-					item.block = true;
-					item.blockSize = dataLen;
-				}
+		//移动到pos位置
+		bool Seek(_m_size pos)
+		{
+			if (pos > m_size)
+				return false;
+			m_pos = pos;
+			return true;
+		}
 
-				dmResList.push_back(item);
-				curMemPos += sizeof(_m_uint);
-			}
-			if(!files)
-				free(m_resource.data);
-			m_resource.data = (_m_byte*)1;
+		//跳过len字节
+		bool Skip(_m_size len)
+		{
+			if (len > m_size - m_pos)
+				return false;
+			m_pos += len;
 			return true;
 		}
 
-		return false;
-	}
+		[[nodiscard]] _m_size Tell() const { return m_pos; }
+		[[nodiscard]] _m_size Remain() const { return m_size - m_pos; }
+		//是否可以直接获取数据指针
+		[[nodiscard]] bool Direct() const { return m_data != nullptr; }
 
-	bool DMResources::CloseResource()
+	private:
+		static constexpr _m_size bufferSize = 1024 * 1024;
+
+		const DMResSource* m_source = nullptr;
+		const _m_byte* m_data = nullptr;
+		_m_size m_size = 0;
+		_m_size m_pos = 0;
+
+		std::vector<_m_byte> m_buffer;
+		_m_size m_bufPos = 0;
+		_m_size m_bufLen = 0;
+	};
+
+	bool DMResources::LoadResList(bool files)
 	{
-		if (m_files) {
-			fclose(m_files);
-			m_files = nullptr;
-		}
-		for (size_t i = 0; i < dmResList.size(); i++)
-		{
-			if (dmResList[i].res.data)
-				dmResList[i].res.Release();
-			if (dmResList[i].text.data)
-				dmResList[i].text.Release();
-		}
-		dmResList.clear();
-		m_resheader.classname = L"";
+		//文件模式的所有读取都不会超过打开时的文件尺寸
+		if (files && m_source->Size() > (_m_ulong64)(_m_size)-1)
+			return false;
+		DMResCursor cursor = files ? DMResCursor(m_source.get(), (_m_size)m_source->Size()) : DMResCursor(m_resource.data, m_resource.size);
+
+		auto snapshot = std::make_shared<DMResSnapshot>();
+#if MUI_CFG_ENABLE_V2DMRES
+		//v2格式以魔数开头 v1格式开头是不超过clsnameMax的类名长度
+		_m_uint magic = 0;
+		bool ret = false;
+		if (cursor.ReadUInt(magic) && magic == DMResV2Magic)
+			ret = ParseResListV2(cursor, files, *snapshot);
+		else if (cursor.Seek(0))
+			ret = ParseResListV1(cursor, files, *snapshot);
+#else
+		const bool ret = ParseResListV1(cursor, files, *snapshot);
+#endif
+		if (!ret)
+			return false;
+
+		std::atomic_store(&m_snapshot, DMResSnapshotPtr(std::move(snapshot)));
+		if (!m_source)
+			free(m_resource.data);
+		m_resource.data = (_m_byte*)1;
+		return true;
+	}
+
+	bool DMResources::ParseResListV1(DMResCursor& cursor, bool files, DMResSnapshot& snapshot)
+	{
+		//读取类名二进制字符串长度
+		_m_uint strLen = 0;
+		if (!cursor.ReadUInt(strLen) || strLen > clsnameMax)
+			return false;
+		//读取类名
+		const _m_byte* clsname = cursor.Read(strLen);
+		if (!clsname)
+			return false;
+		m_resheader.classname = DecipheringText({ (_m_byte*)clsname, strLen }, L"DMResFile");
+		//读取签名和版本号
+		if (!cursor.ReadUInt(strLen) || !cursor.ReadString(strLen, m_resheader.ressign))
+			return false;
+		if (!cursor.ReadUInt(strLen) || !cursor.ReadString(strLen, m_resheader.resver))
+			return false;
+		//读取资源数量
+		if (!cursor.ReadUInt(m_resheader.rescount))
+			return false;
+
+		//每个资源项至少包含4个UINT 数量超出剩余数据时文件无效
+		if (m_resheader.classname == L""
+			|| !m_resheader.rescount || m_resheader.ressign == L""
+			|| m_resheader.resver == L""
+			|| m_resheader.rescount > cursor.Remain() / (sizeof(_m_uint) * 4))
+			return false;
+
+		/*读取资源列表数据*/
+		snapshot.list.reserve(m_resheader.rescount);
+		//读取资源数据或文本 文件模式只记录位置
+		auto readData = [&](UIResource& dst, DMResBuffer& buffer, std::pair<_m_ulong64, _m_uint>& pos)
+		{
+			_m_uint dataLen = 0;
+			if (!cursor.ReadUInt(dataLen))
+				return false;
+			pos = std::make_pair((_m_ulong64)cursor.Tell(), dataLen);
+			dst.size = dataLen;
+			if (dataLen == 0 || files)
+				return cursor.Skip(dataLen);
+			const _m_byte* data = cursor.Read(dataLen);
+			if (!data)
+				return false;
+			SetLoadedData(dst, buffer, data, dataLen);
+			return true;
+		};
+		for (_m_uint i = 0; i < m_resheader.rescount; i++)
+		{
+			DMResItem item;
+			/*数据资源*/
+			if (!readData(item.res, item.resBuffer, item.resPos))
+				return false;
+			/*文本资源*/
+			if (!readData(item.text, item.textBuffer, item.strPos))
+				return false;
+			/*资源名*/
+			_m_uint dataLen = 0;
+			if (!cursor.ReadUInt(dataLen) || !cursor.ReadString(dataLen, item.resname))
+				return false;
+			/*块信息*/
+			if (!cursor.ReadUInt(dataLen))
+				return false;
+			if (dataLen) {
+				item.block = true;
+				item.blockSize = dataLen;
+			}
+			item.source = m_source;
+
+			snapshot.index.emplace(item.resname, snapshot.list.size());
+			snapshot.list.push_back(std::move(item));
+		}
+		return true;
+	}
+
+	void DMResources::SetLoadedData(UIResource& dst, DMResBuffer& buffer, const _m_byte* data, _m_uint size)
+	{
+		dst.size = size;
+		if (IsMapped())
+			dst.data = (_m_byte*)data;
+		else
+		{
+			dst.data = new _m_byte[size];
+			memcpy(dst.data, data, size);
+			buffer = DMResBuffer(dst.data);
+		}
+	}
+
+	bool DMResources::GetItemRaw(const DMResItem& item, bool text, std::vector<_m_byte>& buffer, UIResource& dst)
+	{
+		const UIResource& data = text ? item.text : item.res;
+		const auto& pos = text ? item.strPos : item.resPos;
+		if (data.data || !item.source || pos.second == 0)
+		{
+			dst = data.data ? data : UIResource();
+			return true;
+		}
+		buffer.resize(pos.second);
+		dst = { buffer.data(), pos.second };
+		return item.source->ReadAt(pos.first, buffer.data(), pos.second);
+	}
+
+	void DMResources::AppendUTF16(const std::wstring& str, std::vector<char16_t>& dst)
+	{
+#ifdef _WIN32
+		dst.insert(dst.end(), str.begin(), str.end());
+#endif
+#ifdef __ANDROID__
+		dst.reserve(dst.size() + str.length());
+		for (wchar_t ch : str)
+		{
+			_m_uint wc = (_m_uint)ch;
+			if (wc > 0xFFFF)
+			{
+				wc -= 0x00010000;
+				dst.push_back((char16_t)(0xD800 | (wc >> 10)));
+				dst.push_back((char16_t)(0xDC00 | (wc & 0x03FF)));
+			}
+			else
+				dst.push_back((char16_t)wc);
+		}
+#endif
+	}
+
+	_m_ulong64 DMResources::HashData(const _m_byte* data, _m_size size, _m_ulong64 hash)
+	{
+		for (_m_size i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 0x100000001B3ull;
+		}
+		return hash;
+	}
+
+	_m_ulong64 DMResources::HashName(const std::wstring& name)
+	{
+#ifdef _WIN32
+		return HashData((const _m_byte*)name.data(), name.length() * wsize);
+#else
+		std::vector<char16_t> str;
+		AppendUTF16(name, str);
+		return HashData((const _m_byte*)str.data(), str.size() * wsize);
+#endif
+	}
+
+#if MUI_CFG_ENABLE_V2DMRES
+
+	/*v2格式文件布局
+	* [文件头][目录 按名称哈希排序][字符串表 加密类名+资源名称][资源数据 每个数据按4K对齐 文本紧随数据]
+	* 追加保存时新数据和新的目录 字符串表追加到文件末尾 文件头指向新的目录
+	*/
+	struct DMResources::DMResV2Header
+	{
+		_m_uint magic;//魔数 DMResV2Magic
+		_m_uint version;//格式版本 2
+		_m_uint count;//资源数量
+		_m_uint classLen;//加密类名字节长度 位于字符串表开头
+		_m_ulong64 tocOffset;//目录位置
+		_m_ulong64 strOffset;//字符串表位置
+		_m_ulong64 strSize;//字符串表字节长度
+		_m_ulong64 fileSize;//文件总长度
+		_m_ulong64 tocHash;//目录和字符串表的哈希
+		_m_ulong64 reserved;
+	};
+
+	struct DMResources::DMResV2Entry
+	{
+		_m_ulong64 nameHash;//名称哈希
+		_m_ulong64 resOffset;//数据位置
+		_m_ulong64 textOffset;//文本位置
+		_m_ulong64 resHash;//加密数据哈希
+		_m_ulong64 textHash;//加密文本哈希
+		_m_uint resSize;//数据字节长度
+		_m_uint textSize;//文本字节长度
+		_m_uint nameOffset;//名称在字符串表中的位置
+		_m_uint nameLen;//名称UTF-16长度
+		_m_uint blockSize;//块尺寸
+		_m_uint flags;//资源标志
+		_m_uint rawSize;//压缩资源的原数据尺寸
+		_m_uint reserved;
+	};
+
+	bool DMResources::ParseResListV2(DMResCursor& cursor, bool files, DMResSnapshot& snapshot)
+	{
+		static_assert(sizeof(DMResV2Header) == 64, "DMResV2Header size mismatch");
+		static_assert(sizeof(DMResV2Entry) == 72, "DMResV2Entry size mismatch");
+		DMResV2Header header;
+		const _m_byte* data = cursor.Seek(0) ? cursor.Read(sizeof(header)) : nullptr;
+		if (!data)
+			return false;
+		memcpy(&header, data, sizeof(header));
+
+		const _m_size fileSize = cursor.Tell() + cursor.Remain();
+		//追加保存中断时文件尾部可能有未被引用的数据
+		if (header.version != 2 || header.count == 0 || header.fileSize > fileSize
+			|| header.tocOffset > fileSize || header.count > (fileSize - header.tocOffset) / sizeof(DMResV2Entry)
+			|| header.strOffset > fileSize || header.strSize > fileSize - header.strOffset
+			|| header.classLen > clsnameMax * wsize || header.classLen > header.strSize)
+			return false;
+
+		//读取目录和字符串表 并校验哈希
+		const _m_size tocSize = (_m_size)header.count * sizeof(DMResV2Entry);
+		std::vector<DMResV2Entry> toc(header.count);
+		if (!cursor.Seek(header.tocOffset) || !(data = cursor.Read(tocSize)))
+			return false;
+		memcpy(toc.data(), data, (size_t)tocSize);
+		const _m_ulong64 tocHash = HashData(data, tocSize);
+		if (!cursor.Seek(header.strOffset) || !(data = cursor.Read(header.strSize)))
+			return false;
+		if (HashData(data, header.strSize, tocHash) != header.tocHash)
+			return false;
+		const _m_byte* strTable = data;
+
+		m_resheader.classname = DecipheringText({ (_m_byte*)strTable, header.classLen }, L"DMResFile");
+		m_resheader.ressign = L"DreamMoonResFile";
+		m_resheader.resver = DMResVer2;
+		m_resheader.rescount = header.count;
+		if (m_resheader.classname == L"")
+			return false;
+
+		//内存和映射模式直接从数据中获取资源 文件模式只记录位置
+		const _m_byte* base = files ? nullptr : m_resource.data;
+		snapshot.list.reserve(header.count);
+		for (const auto& entry : toc)
+		{
+			if (entry.nameOffset < header.classLen || entry.nameOffset > header.strSize
+				|| entry.nameLen > (header.strSize - entry.nameOffset) / wsize
+				|| entry.resOffset > fileSize || entry.resSize > fileSize - entry.resOffset
+				|| entry.textOffset > fileSize || entry.textSize > fileSize - entry.textOffset
+				|| (!snapshot.list.empty() && entry.nameHash < snapshot.list.back().nameHash))
+				return false;
+
+			DMResItem item;
+			item.resname = wchar16Towchar32((const char16_t*)(strTable + entry.nameOffset), entry.nameLen);
+			item.block = (entry.flags & DMResV2Block) != 0;
+			item.blockSize = entry.blockSize;
+			item.compress = (entry.flags & DMResV2Compress) != 0;
+			item.rawSize = entry.rawSize;
+			item.resPos = std::make_pair(entry.resOffset, entry.resSize);
+			item.strPos = std::make_pair(entry.textOffset, entry.textSize);
+			item.res.size = entry.resSize;
+			item.text.size = entry.textSize;
+			if (base && entry.resSize)
+				SetLoadedData(item.res, item.resBuffer, base + entry.resOffset, entry.resSize);
+			if (base && entry.textSize)
+				SetLoadedData(item.text, item.textBuffer, base + entry.textOffset, entry.textSize);
+			item.nameHash = entry.nameHash;
+			item.resHash = entry.resHash;
+			item.textHash = entry.textHash;
+			item.resStored = true;
+			item.textStored = true;
+			item.source = m_source;
+			snapshot.list.push_back(std::move(item));
+		}
+		snapshot.sorted = true;
+		m_v2File = true;
+		return true;
+	}
+
+	void DMResources::MakeTocV2(const DMResSnapshot& snapshot, std::vector<const DMResItem*>& order,
+		std::vector<DMResV2Entry>& toc, std::vector<_m_byte>& strTable, _m_uint& classLen)
+	{
+		m_resheader.rescount = (_m_uint)snapshot.list.size();
+		m_resheader.ressign = L"DreamMoonResFile";
+		m_resheader.resver = DMResVer2;
+
+		//目录按名称哈希排序
+		std::vector<std::pair<_m_ulong64, const DMResItem*>> sorted;
+		sorted.reserve(snapshot.list.size());
+		for (const auto& item : snapshot.list)
+			sorted.emplace_back(HashName(item.resname), &item);
+		std::stable_sort(sorted.begin(), sorted.end(),
+			[](const auto& a, const auto& b) { return a.first < b.first; });
+
+		//字符串表 开头是加密的类名 之后是资源名称
+		UIResource classname = EncipheringText(m_resheader.classname, L"DMResFile");
+		classLen = (_m_uint)classname.size;
+		std::vector<char16_t> names;
+		order.resize(sorted.size());
+		toc.resize(sorted.size());
+		for (size_t i = 0; i < sorted.size(); i++)
+		{
+			const DMResItem& item = *sorted[i].second;
+			DMResV2Entry& entry = toc[i];
+			memset(&entry, 0, sizeof(entry));
+			entry.nameHash = sorted[i].first;
+			entry.nameOffset = (_m_uint)(classLen + names.size() * wsize);
+			const size_t length = names.size();
+			AppendUTF16(item.resname, names);
+			entry.nameLen = (_m_uint)(names.size() - length);
+			entry.blockSize = item.blockSize;
+			entry.flags = (item.block ? DMResV2Block : 0) | (item.compress ? DMResV2Compress : 0);
+			entry.rawSize = item.rawSize;
+			order[i] = &item;
+		}
+
+		strTable.resize(classLen + names.size() * wsize);
+		if (classLen)
+			memcpy(strTable.data(), classname.data, classLen);
+		if (!names.empty())
+			memcpy(strTable.data() + classLen, names.data(), names.size() * wsize);
+		classname.Release();
+	}
+
+	bool DMResources::WriteTocV2(FILE* file, const DMResV2Header& header, const std::vector<DMResV2Entry>& toc,
+		const std::vector<_m_byte>& strTable)
+	{
+		//先写入目录和字符串表 文件头最后写入 写入中断时旧文件头仍然有效
+		if (!SeekFile(file, header.tocOffset, SEEK_SET))
+			return false;
+		fwrite(toc.data(), 1, toc.size() * sizeof(DMResV2Entry), file);
+		fwrite(strTable.data(), 1, strTable.size(), file);
+		if (fflush(file) != 0 || fseek(file, 0, SEEK_SET) != 0)
+			return false;
+		fwrite(&header, 1, sizeof(header), file);
+		return fflush(file) == 0 && ferror(file) == 0;
+	}
+
+	bool DMResources::WriteResListV2(FILE* file, const DMResSnapshot& snapshot)
+	{
+		std::vector<const DMResItem*> order;
+		std::vector<DMResV2Entry> toc;
+		std::vector<_m_byte> strTable;
+		_m_uint classLen = 0;
+		MakeTocV2(snapshot, order, toc, strTable, classLen);
+
+		DMResV2Header header;
+		memset(&header, 0, sizeof(header));
+		header.magic = DMResV2Magic;
+		header.version = 2;
+		header.count = m_resheader.rescount;
+		header.classLen = classLen;
+		header.tocOffset = sizeof(header);
+		header.strOffset = header.tocOffset + toc.size() * sizeof(DMResV2Entry);
+		header.strSize = strTable.size();
+
+		//先写入文件头和目录占位 数据写入后回填位置和哈希
+		fwrite(&header, 1, sizeof(header), file);
+		fwrite(toc.data(), 1, toc.size() * sizeof(DMResV2Entry), file);
+		fwrite(strTable.data(), 1, strTable.size(), file);
+
+		static const _m_byte zero[DMResV2Align] = { 0 };
+		_m_ulong64 pos = header.strOffset + header.strSize;
+		std::vector<_m_byte> buffer;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			const DMResItem& item = *order[i];
+			DMResV2Entry& entry = toc[i];
+			//资源数据按4K对齐
+			UIResource data;
+			if (!GetItemRaw(item, false, buffer, data))
+				return false;
+			if (data.size)
+			{
+				const _m_ulong64 aligned = (pos + DMResV2Align - 1) / DMResV2Align * DMResV2Align;
+				fwrite(zero, 1, (size_t)(aligned - pos), file);
+				pos = aligned;
+				fwrite(data.data, 1, data.size, file);
+			}
+			entry.resOffset = pos;
+			entry.resSize = (_m_uint)data.size;
+			entry.resHash = HashData(data.data, data.size);
+			pos += data.size;
+			//文本紧随资源数据
+			if (!GetItemRaw(item, true, buffer, data))
+				return false;
+			if (data.size)
+				fwrite(data.data, 1, data.size, file);
+			entry.textOffset = pos;
+			entry.textSize = (_m_uint)data.size;
+			entry.textHash = HashData(data.data, data.size);
+			pos += data.size;
+		}
+		header.fileSize = pos;
+		header.tocHash = HashData(strTable.data(), strTable.size(),
+			HashData((const _m_byte*)toc.data(), toc.size() * sizeof(DMResV2Entry)));
+
+		return WriteTocV2(file, header, toc, strTable);
+	}
+
+	bool DMResources::AppendResListV2(FILE* file, DMResSnapshot& snapshot)
+	{
+		std::vector<const DMResItem*> order;
+		std::vector<DMResV2Entry> toc;
+		std::vector<_m_byte> strTable;
+		_m_uint classLen = 0;
+		MakeTocV2(snapshot, order, toc, strTable, classLen);
+
+		//新数据追加到文件末尾 已保存的数据保持原位置
+		if (!SeekFile(file, 0, SEEK_END))
+			return false;
+		const _m_long64 end = TellFile(file);
+		if (end < (_m_long64)sizeof(DMResV2Header))
+			return false;
+
+		static const _m_byte zero[DMResV2Align] = { 0 };
+		_m_ulong64 pos = (_m_ulong64)end;
+		std::vector<_m_byte> buffer;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			const DMResItem& item = *order[i];
+			DMResV2Entry& entry = toc[i];
+			UIResource data;
+			if (item.resStored)
+			{
+				entry.resOffset = item.resPos.first;
+				entry.resSize = item.resPos.second;
+				entry.resHash = item.resHash;
+			}
+			else
+			{
+				if (!GetItemRaw(item, false, buffer, data))
+					return false;
+				if (data.size)
+				{
+					const _m_ulong64 aligned = (pos + DMResV2Align - 1) / DMResV2Align * DMResV2Align;
+					fwrite(zero, 1, (size_t)(aligned - pos), file);
+					pos = aligned;
+					fwrite(data.data, 1, data.size, file);
+				}
+				entry.resOffset = pos;
+				entry.resSize = (_m_uint)data.size;
+				entry.resHash = HashData(data.data, data.size);
+				pos += data.size;
+			}
+			if (item.textStored)
+			{
+				entry.textOffset = item.strPos.first;
+				entry.textSize = item.strPos.second;
+				entry.textHash = item.textHash;
+			}
+			else
+			{
+				if (!GetItemRaw(item, true, buffer, data))
+					return false;
+				if (data.size)
+					fwrite(data.data, 1, data.size, file);
+				entry.textOffset = pos;
+				entry.textSize = (_m_uint)data.size;
+				entry.textHash = HashData(data.data, data.size);
+				pos += data.size;
+			}
+		}
+
+		//新的目录和字符串表位于文件末尾 按8字节对齐
+		const _m_ulong64 aligned = (pos + 7) / 8 * 8;
+		fwrite(zero, 1, (size_t)(aligned - pos), file);
+		pos = aligned;
+
+		DMResV2Header header;
+		memset(&header, 0, sizeof(header));
+		header.magic = DMResV2Magic;
+		header.version = 2;
+		header.count = m_resheader.rescount;
+		header.classLen = classLen;
+		header.tocOffset = pos;
+		header.strOffset = header.tocOffset + toc.size() * sizeof(DMResV2Entry);
+		header.strSize = strTable.size();
+		header.fileSize = header.strOffset + header.strSize;
+		header.tocHash = HashData(strTable.data(), strTable.size(),
+			HashData((const _m_byte*)toc.data(), toc.size() * sizeof(DMResV2Entry)));
+		if (!WriteTocV2(file, header, toc, strTable))
+			return false;
+
+		//更新资源项为已保存状态 并按目录顺序排列 文件模式下释放已写入文件的数据
+		std::vector<DMResItem> list;
+		list.reserve(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			DMResItem item = *order[i];
+			const DMResV2Entry& entry = toc[i];
+			item.nameHash = entry.nameHash;
+			item.resPos = std::make_pair(entry.resOffset, entry.resSize);
+			item.strPos = std::make_pair(entry.textOffset, entry.textSize);
+			item.resHash = entry.resHash;
+			item.textHash = entry.textHash;
+			item.resStored = true;
+			item.textStored = true;
+			if (IsFileMode())
+			{
+				SetItemData(item.res, item.resBuffer, UIResource());
+				SetItemData(item.text, item.textBuffer, UIResource());
+				item.res.size = entry.resSize;
+				item.text.size = entry.textSize;
+				item.source = m_source;
+			}
+			list.push_back(std::move(item));
+		}
+		snapshot.list = std::move(list);
+		snapshot.index.clear();
+		snapshot.sorted = true;
+		return true;
+	}
+
+	bool DMResources::SaveResourceAppend()
+	{
+		if (!m_v2File || m_filePath.empty() || IsMapped())
+			return false;
+		return ModifyResList([this](DMResSnapshot& list)
+		{
+			FILE* file = OpenWriteFile(m_filePath, true);
+			if (!file)
+				return false;
+			const bool ret = AppendResListV2(file, list);
+			return fclose(file) == 0 && ret;
+		});
+	}
+
+	bool DMResources::VerifyResource(std::wstring resname)
+	{
+		const auto snapshot = GetSnapshot();
+		if (!snapshot)
+			return false;
+		std::vector<_m_byte> buffer;
+		//只有已保存到文件的内容才有哈希
+		auto verify = [&](const DMResItem& item)
+		{
+			UIResource data;
+			if (item.resStored && (!GetItemRaw(item, false, buffer, data) || HashData(data.data, data.size) != item.resHash))
+				return false;
+			return !item.textStored || (GetItemRaw(item, true, buffer, data) && HashData(data.data, data.size) == item.textHash);
+		};
+		if (!resname.empty())
+		{
+			const DMResItem* item = snapshot->Find(resname);
+			return item && verify(*item);
+		}
+		for (const auto& item : snapshot->list)
+		{
+			if (!verify(item))
+				return false;
+		}
+		return true;
+	}
+
+	bool DMResources::EnumResourceHash(std::vector<std::pair<std::wstring, _m_ulong64>>& list)
+	{
+		list.clear();
+		if (!m_resource.data)
+			return false;
+		const auto snapshot = GetSnapshot();
+		if (!snapshot)
+			return true;
+		list.reserve(snapshot->list.size());
+		for (const auto& item : snapshot->list)
+		{
+			_m_ulong64 hash = 0;
+			//数据和文本的哈希合并为一个
+			if (item.resStored || item.textStored)
+				hash = HashData((const _m_byte*)&item.textHash, sizeof(item.textHash), item.resHash);
+			list.emplace_back(item.resname, hash);
+		}
+		return true;
+	}
+
+	bool DMResources::ConvertResource(std::wstring srcfile, std::wstring dstfile)
+	{
+		DMResources res;
+		//优先使用映射模式 不需要将全部数据读入内存
+		if (!res.LoadResourceMapped(srcfile) && !res.LoadResource(srcfile, false))
+			return false;
+		return res.SaveResource(dstfile, true);
+	}
+
+#endif // MUI_CFG_ENABLE_V2DMRES
+
+	const DMResources::DMResItem* DMResources::DMResSnapshot::Find(const std::wstring& resname) const
+	{
+		if (sorted)
+		{
+			//按名称哈希二分查找 哈希相同时比较名称
+			const _m_ulong64 hash = HashName(resname);
+			auto iter = std::lower_bound(list.begin(), list.end(), hash,
+				[](const DMResItem& item, _m_ulong64 value) { return item.nameHash < value; });
+			for (; iter != list.end() && iter->nameHash == hash; ++iter)
+			{
+				if (iter->resname == resname)
+					return &*iter;
+			}
+			return nullptr;
+		}
+		if (auto iter = index.find(resname); iter != index.end())
+			return &list[iter->second];
+		return nullptr;
+	}
+
+	void DMResources::DMResSnapshot::BuildIndex()
+	{
+		index.clear();
+		index.reserve(list.size());
+		for (size_t i = 0; i < list.size(); i++)
+			index.emplace(list[i].resname, i);
+		sorted = false;
+	}
+
+	bool DMResources::ModifyResList(const std::function<bool(DMResSnapshot&)>& modify)
+	{
+		std::lock_guard<std::mutex> lock(mx);
+		auto snapshot = std::make_shared<DMResSnapshot>();
+		if (const auto current = GetSnapshot())
+			*snapshot = *current;
+		//修改会改变顺序和名称 改用名称索引
+		if (snapshot->sorted)
+			snapshot->BuildIndex();
+		if (!modify(*snapshot))
+			return false;
+		std::atomic_store(&m_snapshot, DMResSnapshotPtr(std::move(snapshot)));
+		return true;
+	}
+
+	void DMResources::SetItemData(UIResource& dst, DMResBuffer& buffer, UIResource data)
+	{
+		buffer = DMResBuffer(data.data);
+		dst = data.data ? data : UIResource();
+	}
+
+	bool DMResources::CloseResource()
+	{
+		//仍在使用的快照和数据流持有数据源 最后一个持有者释放时关闭文件和取消映射
+		m_source = nullptr;
+		std::atomic_store(&m_snapshot, DMResSnapshotPtr());
+		m_filePath.clear();
+		m_v2File = false;
+		m_resheader.classname = L"";
 		m_resheader.rescount = 0;
 		m_resheader.ressign = L"";
 		m_resheader.resver = L"";
@@ -723,6 +1430,135 @@ namespace Mui {
 		return true;
 	}
 
+	DMResources::DMResSource::~DMResSource()
+	{
+#ifdef _WIN32
+		if (m_view)
+			UnmapViewOfFile(m_view);
+		if (m_file != INVALID_HANDLE_VALUE)
+			CloseHandle(m_file);
+#endif // _WIN32
+#ifdef __ANDROID__
+		if (m_view)
+			munmap(m_view, (size_t)m_size);
+		if (m_file != -1)
+			close(m_file);
+#endif // __ANDROID__
+	}
+
+	DMResources::DMResSourcePtr DMResources::DMResSource::Open(const std::wstring& path)
+	{
+		auto source = std::make_shared<DMResSource>();
+#ifdef _WIN32
+		//允许追加保存时写入 以及整理时替换原文件
+		source->m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_RANDOM_ACCESS, nullptr);
+		if (source->m_file == INVALID_HANDLE_VALUE)
+			return nullptr;
+		LARGE_INTEGER size = { 0 };
+		if (!GetFileSizeEx(source->m_file, &size))
+			return nullptr;
+		source->m_size = (_m_ulong64)size.QuadPart;
+		return source;
+#endif // _WIN32
+#ifdef __ANDROID__
+		source->m_file = open(Helper::M_WStringToString(path).c_str(), O_RDONLY | O_CLOEXEC);
+		if (source->m_file == -1)
+			return nullptr;
+		struct stat st = {};
+		if (fstat(source->m_file, &st) != 0)
+			return nullptr;
+		source->m_size = (_m_ulong64)st.st_size;
+		return source;
+#endif // __ANDROID__
+		return nullptr;
+	}
+
+	DMResources::DMResSourcePtr DMResources::DMResSource::Map(const std::wstring& path)
+	{
+		auto source = std::make_shared<DMResSource>();
+#ifdef _WIN32
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return nullptr;
+		LARGE_INTEGER size = { 0 };
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || (_m_ulong64)size.QuadPart > (_m_ulong64)(size_t)-1)
+		{
+			CloseHandle(file);
+			return nullptr;
+		}
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		//视图会保持映射对象有效 句柄可以立即关闭
+		CloseHandle(file);
+		if (!mapping)
+			return nullptr;
+		source->m_view = (_m_byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (!source->m_view)
+			return nullptr;
+		source->m_size = (_m_ulong64)size.QuadPart;
+		return source;
+#endif // _WIN32
+#ifdef __ANDROID__
+		int file = open(Helper::M_WStringToString(path).c_str(), O_RDONLY | O_CLOEXEC);
+		if (file == -1)
+			return nullptr;
+		struct stat st = {};
+		if (fstat(file, &st) != 0 || st.st_size == 0 || (_m_ulong64)st.st_size > (_m_ulong64)(size_t)-1)
+		{
+			close(file);
+			return nullptr;
+		}
+		void* view = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, file, 0);
+		close(file);
+		if (view == MAP_FAILED)
+			return nullptr;
+		source->m_view = (_m_byte*)view;
+		source->m_size = (_m_ulong64)st.st_size;
+		return source;
+#endif // __ANDROID__
+		return nullptr;
+	}
+
+	bool DMResources::DMResSource::ReadAt(_m_ulong64 pos, void* dst, _m_size len) const
+	{
+		if (m_view)
+		{
+			if (pos > m_size || len > m_size - pos)
+				return false;
+			memcpy(dst, m_view + pos, (size_t)len);
+			return true;
+		}
+#ifdef _WIN32
+		if (m_file == INVALID_HANDLE_VALUE || len > (DWORD)-1)
+			return false;
+		//每个线程使用自己的事件等待读取完成 同一句柄上的读取互不阻塞
+		struct ReadEvent
+		{
+			HANDLE event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+			~ReadEvent() { if (event) CloseHandle(event); }
+		};
+		thread_local ReadEvent readEvent;
+		if (!readEvent.event)
+			return false;
+		OVERLAPPED overlapped = { 0 };
+		overlapped.Offset = (DWORD)(pos & 0xFFFFFFFF);
+		overlapped.OffsetHigh = (DWORD)(pos >> 32);
+		overlapped.hEvent = readEvent.event;
+		if (!ReadFile(m_file, dst, (DWORD)len, nullptr, &overlapped) && GetLastError() != ERROR_IO_PENDING)
+			return false;
+		DWORD read = 0;
+		return GetOverlappedResult(m_file, &overlapped, &read, TRUE) && read == len;
+#endif // _WIN32
+#ifdef __ANDROID__
+		if (m_file == -1)
+			return false;
+		return pread64(m_file, dst, (size_t)len, (off64_t)pos) == (ssize_t)len;
+#endif // __ANDROID__
+		return false;
+	}
+
 	UIResource DMResources::ReadFiles(std::wstring filepath, bool string)
 	{
 		FILE* file;
@@ -806,34 +1642,30 @@ namespace Mui {
 #endif
 	}
 
-	std::wstring DMResources::wchar16Towchar32(char16_t* wchar16, _m_uint len) {
+	std::wstring DMResources::wchar16Towchar32(const char16_t* wchar16, _m_uint len) {
+		//直接构造结果 不使用临时缓冲区 遇到字符串结尾时停止
+		const char16_t* end = std::find(wchar16, wchar16 + len, u'\0');
 #ifdef _WIN32
-		return std::wstring((wchar_t*)wchar16);
+		return std::wstring((const wchar_t*)wchar16, end - wchar16);
 #endif
 #ifdef __ANDROID__
-		wchar_t* wcs = new wchar_t [len + 1];
-		int u32;
-		unsigned short* end = (u_short*)(wchar16 + len);
-		wchar_t* ret = wcs;
-		int u32low = 0;
-		while ((u_short*)(wchar16) < end)
-		{
-			u32 = *wchar16++;
-			if (u32 >= 0xD800 && u32 < 0xDC00)
+		std::wstring ret;
+		ret.reserve(end - wchar16);
+		while (wchar16 < end)
+		{
+			int u32 = *wchar16++;
+			if (u32 >= 0xD800 && u32 < 0xDC00 && wchar16 < end)
 			{
-				u32low = *wchar16++;
+				int u32low = *wchar16++;
 				u32 &= 0x3FF;
 				u32low &= 0x3FF;
 				u32 <<= 10;
 				u32 += u32low;
 				u32 += 0x10000;
 			}
-			*wcs++ = u32;
+			ret.push_back((wchar_t)u32);
 		}
-		ret[len] = L'\0';
-		std::wstring ret1 = ret;
-		delete[] ret;
-		return ret1;
+		return ret;
 #endif
 	}
 
@@ -861,27 +1693,70 @@ namespace Mui {
 		return reinterpret_cast<char16_t *>(ret);
     }
 
-	UIResource DMResources::Enciphering(UIResource res, std::wstring key)
+	DMResources::DMKeySchedule DMResources::GetKeySchedule(const std::wstring& key)
 	{
-		_m_byte * key_ = HexStringToBytes(Sha256StringHex(key));
-		_m_byte* iv_ = HexStringToBytes(Sha256StringHex(key).substr(0, 32));
+		const bool cached = m_keyCacheEnabled;
+		if (const auto cache = cached ? std::atomic_load(&m_keyCache) : nullptr)
+		{
+			if (auto iter = cache->find(key); iter != cache->end())
+				return iter->second;
+		}
 
-		_m_byte* pOut = new _m_byte[res.size];
+		//在锁外计算 多个线程同时计算同一秘钥的结果相同
+		DMKeySchedule schedule;
+		_m_byte* key_ = HexStringToBytes(Sha256StringHex(key));
+		memcpy(schedule.key, key_, sizeof(schedule.key));
+		//iv为sha256的前16字节
+		memcpy(schedule.iv, key_, sizeof(schedule.iv));
+		delete[] key_;
+#ifndef DMRES_USE_CRYPTOPP
+		AES256_KeyExpansion(schedule.roundKey, schedule.key);
+#endif
+		if (!cached)
+			return schedule;
+
+		std::lock_guard<std::mutex> lock(m_keyLock);
+		auto cache = std::make_shared<DMKeyCache>();
+		//通常只有少量秘钥 超出上限时丢弃旧的缓存
+		if (const auto current = std::atomic_load(&m_keyCache); current && current->size() < 16)
+			*cache = *current;
+		(*cache)[key] = schedule;
+		std::atomic_store(&m_keyCache, std::shared_ptr<const DMKeyCache>(std::move(cache)));
+		return schedule;
+	}
+
+	void DMResources::EnableKeyCache(bool enable)
+	{
+		m_keyCacheEnabled = enable;
+	}
 
+	void DMResources::CipherTo(UIResource src, _m_byte* out, const DMKeySchedule& schedule, bool encrypt)
+	{
 #ifdef DMRES_USE_CRYPTOPP
-		CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption encryption(key_, CryptoPP::AES::MAX_KEYLENGTH, iv_);
-		encryption.ProcessData(pOut, res.data, res.size);
-		res.data = pOut;
+		if (encrypt)
+		{
+			CryptoPP::CFB_Mode<CryptoPP::AES>::Encryption encryption(schedule.key, CryptoPP::AES::MAX_KEYLENGTH, schedule.iv);
+			encryption.ProcessData(out, src.data, src.size);
+		}
+		else
+		{
+			CryptoPP::CFB_Mode<CryptoPP::AES>::Decryption decryption(schedule.key, CryptoPP::AES::MAX_KEYLENGTH, schedule.iv);
+			decryption.ProcessData(out, src.data, src.size);
+		}
 #else
-		AES256_CFB(res, pOut, key_, iv_, true);
-		res.data = pOut;
+		AES256_CFB_Expanded(src, out, schedule.roundKey, schedule.iv, encrypt);
 #endif
-		delete[] key_;
-		delete[] iv_;
+	}
+
+	UIResource DMResources::Enciphering(UIResource res, const std::wstring& key)
+	{
+		_m_byte* pOut = new _m_byte[res.size];
+		CipherTo(res, pOut, GetKeySchedule(key), true);
+		res.data = pOut;
 		return res;
 	}
 
-	UIResource DMResources::EncipheringText(std::wstring text, std::wstring key)
+	UIResource DMResources::EncipheringText(std::wstring text, const std::wstring& key)
 	{
 		UIResource res;
 #ifdef _WIN32
@@ -899,96 +1774,76 @@ namespace Mui {
 		return res;
 	}
 
-	UIResource DMResources::Deciphering(UIResource res, std::wstring key)
+	UIResource DMResources::Deciphering(UIResource res, const std::wstring& key)
 	{
-		_m_byte* key_ = HexStringToBytes(Sha256StringHex(key));
-		_m_byte* iv_ = HexStringToBytes(Sha256StringHex(key).substr(0, 32));
-
 		_m_byte* pOut = new _m_byte[res.size];
-
-#ifdef DMRES_USE_CRYPTOPP
-		CryptoPP::CFB_Mode<CryptoPP::AES>::Decryption decryption(key_, CryptoPP::AES::MAX_KEYLENGTH, iv_);
-		decryption.ProcessData(pOut, res.data, res.size);
-		res.data = pOut;
-#else
-		AES256_CFB(res, pOut, key_, iv_, false);
+		CipherTo(res, pOut, GetKeySchedule(key), false);
 		res.data = pOut;
-#endif
-		delete[] key_;
-		delete[] iv_;
 		return res;
 	}
 
-	std::wstring DMResources::DecipheringText(UIResource res, std::wstring key)
+	std::wstring DMResources::DecipheringText(UIResource res, const std::wstring& key)
 	{
-		res.size += wsize;
-		UIResource out = Deciphering(res, key);
-		for (size_t i = 0; i < wsize; i++)
-		{
-			out.data[out.size - 1 - i] = '\0';
-		}
+		//只解密原数据长度 多分配一个字符作为结尾 避免读取越界
+		UIResource out(new _m_byte[res.size + wsize], res.size);
+		CipherTo(res, out.data, GetKeySchedule(key), false);
+		memset(out.data + res.size, 0, wsize);
 
-		std::wstring ret = wchar16Towchar32((char16_t*)out.data, _m_uint(res.size / 2));
-		ret = ret;
+		std::wstring ret = wchar16Towchar32((char16_t*)out.data, _m_uint(res.size / wsize));
 		out.Release();
 		return ret;
 	}
 
-	void DMResources::EncBlockProc(UIResource res, std::wstring resname, std::wstring key, _m_uint blocksize, UIResource* ret, DMEncBlockCallback callback)
+	void DMResources::EncBlockProc(UIResource res, std::wstring resname, std::wstring key, _m_uint blocksize, UIResource* ret, DMEncBlockCallback callback, bool compress)
 	{
-		_m_byte* buffer = new _m_byte[res.size];
+		//多个工作线程同时报告进度 加锁保证进度递增 完成回调在全部块编码结束后调用
+		std::mutex progressLock;
 		_m_size ensize = 0;//已编码资源
-		_m_ulong offset = 0;//偏移指针
-		while (ensize != res.size)
-		{
-			//要写入内存的大小
-			_m_size writeSize = blocksize;
-			//如果剩余数据小于块大小 将块大小设置为剩余数据大小
-			if (offset + blocksize > res.size)
-				writeSize = res.size - offset;
-
-			UIResource block;
-			block.data = res.data + offset;
-			block.size = writeSize;
-
-			UIResource encData = Enciphering(block, key);
-			memcpy(buffer + offset, encData.data, writeSize);
-			encData.Release();
-
-			offset += blocksize;
-			ensize += writeSize;
-			if (callback.callback)
+		auto progress = [&](_m_size size)
+		{
+			if (!callback.callback)
+				return;
+			std::lock_guard<std::mutex> lock(progressLock);
+			ensize += size;
+			if (ensize != res.size)
 				callback.callback(ensize, res.size, callback.param);
+		};
+		UIResource data;
+		if (compress)
+			data = EncCompressedBlocks(res, key, blocksize, progress);
+		else
+		{
+			data = UIResource(new _m_byte[res.size], res.size);
+			CipherBlocks(res, data.data, key, blocksize, true, progress);
 		}
 		if (callback.callback)
 		{
-			for (size_t i = 0; i < dmResList.size(); i++)
+			const bool installed = ModifyResList([&](DMResSnapshot& list)
 			{
-				DMResItem* item = &dmResList[i];
-				if (item->resname == resname)
-				{
-					if (item->res.data)
-					item->res.Release();
-					item->res.data = buffer;
-					item->res.size = res.size;
-					return;
-				}
-			}
-			delete[] buffer;
+				auto iter = list.index.find(resname);
+				if (iter == list.index.end())
+					return false;
+				DMResItem& item = list.list[iter->second];
+				SetItemData(item.res, item.resBuffer, data);
+				return true;
+			});
+			if (!installed)
+				data.Release();
+			callback.callback(res.size, res.size, callback.param);
 		}
 		else if (ret)
-			*ret = UIResource(buffer, res.size);
+			*ret = data;
 		else
-			delete[] buffer;
+			data.Release();
 	}
 
-	UIResource DMResources::EncBlockResource(UIResource res, std::wstring resname, std::wstring key, _m_uint blocksize, DMEncBlockCallback callback)
+	UIResource DMResources::EncBlockResource(UIResource res, std::wstring resname, std::wstring key, _m_uint blocksize, DMEncBlockCallback callback, bool compress)
 	{
-		if (blocksize > res.size || blocksize == 0)
+		if (!compress && (blocksize > res.size || blocksize == 0))
 			return Enciphering(res, key);
 		else
 		{
-			std::thread encthread = std::thread(&DMResources::EncBlockProc, this, res, resname, key, blocksize, &res, callback);
+			std::thread encthread = std::thread(&DMResources::EncBlockProc, this, res, resname, key, blocksize, &res, callback, compress);
 			if(callback.callback)
 				encthread.detach();
 			else {
@@ -998,5 +1853,448 @@ namespace Mui {
 		}
 		return UIResource();
 	}
+
+	UIResource DMResources::DecBlockResource(UIResource res, const std::wstring& key, _m_uint blocksize)
+	{
+		if (blocksize >= res.size || blocksize == 0)
+			return Deciphering(res, key);
+		UIResource ret(new _m_byte[res.size], res.size);
+		CipherBlocks(res, ret.data, key, blocksize, false, nullptr);
+		return ret;
+	}
+
+	void DMResources::CipherBlocks(UIResource src, _m_byte* out, const std::wstring& key, _m_uint blocksize, bool encrypt,
+		const std::function<void(_m_size)>& progress)
+	{
+		const DMKeySchedule schedule = GetKeySchedule(key);
+		const _m_size blockCount = (src.size + blocksize - 1) / blocksize;
+		ParallelFor(blockCount, src.size, [&](_m_size i)
+		{
+			const _m_size offset = i * blocksize;
+			//最后一块可能小于块尺寸
+			const _m_size size = Helper::M_MIN((_m_size)blocksize, src.size - offset);
+			CipherTo({ src.data + offset, size }, out + offset, schedule, encrypt);
+			if (progress)
+				progress(size);
+		});
+	}
+
+	namespace
+	{
+		//并行处理的最小数据量 更小时线程调度的开销大于并行的收益
+		constexpr _m_size parallelMin = 128 * 1024;
+		//为false时总是在当前线程依次处理
+		std::atomic_bool parallelEnabled = true;
+
+		/*资源编解码使用的常驻工作线程池 首次并行处理时创建
+		* 线程数为CPU核心数减一 提交任务的线程也参与处理 多个线程可以同时提交任务
+		*/
+		class DMWorkerPool
+		{
+		public:
+			static DMWorkerPool& Get()
+			{
+				static DMWorkerPool pool;
+				return pool;
+			}
+
+			~DMWorkerPool()
+			{
+				{
+					std::lock_guard lock(m_lock);
+					m_exit = true;
+				}
+				m_cond.notify_all();
+				for (auto& thread : m_threads)
+					thread.join();
+			}
+
+			[[nodiscard]] bool HasWorker() const { return !m_threads.empty(); }
+
+			//处理count个任务 返回时全部任务已完成
+			void Run(_m_size count, const std::function<void(_m_size)>& proc)
+			{
+				auto job = std::make_shared<Job>();
+				job->proc = &proc;
+				job->count = count;
+				{
+					std::lock_guard lock(m_lock);
+					m_jobs.push_back(job);
+				}
+				m_cond.notify_all();
+
+				Work(*job);
+
+				//任务已全部被领取 等待其他线程完成已领取的部分
+				std::unique_lock lock(m_lock);
+				if (const auto iter = std::find(m_jobs.begin(), m_jobs.end(), job); iter != m_jobs.end())
+					m_jobs.erase(iter);
+				m_done.wait(lock, [&] { return job->done == count; });
+			}
+
+		private:
+			struct Job
+			{
+				const std::function<void(_m_size)>* proc = nullptr;
+				_m_size count = 0;
+				std::atomic<_m_size> next = 0;
+				//已完成的任务数 使用m_lock保护
+				_m_size done = 0;
+			};
+			using JobPtr = std::shared_ptr<Job>;
+
+			DMWorkerPool()
+			{
+				const _m_size count = (_m_size)std::thread::hardware_concurrency();
+				for (_m_size i = 1; i < count; ++i)
+					m_threads.emplace_back(&DMWorkerPool::ThreadProc, this);
+			}
+
+			//领取并处理任务 直到全部任务都被领取
+			void Work(Job& job)
+			{
+				_m_size finished = 0;
+				for (_m_size i = job.next++; i < job.count; i = job.next++)
+				{
+					(*job.proc)(i);
+					++finished;
+				}
+				if (finished == 0)
+					return;
+				bool all;
+				{
+					std::lock_guard lock(m_lock);
+					job.done += finished;
+					all = job.done == job.count;
+				}
+				if (all)
+					m_done.notify_all();
+			}
+
+			void ThreadProc()
+			{
+				std::unique_lock lock(m_lock);
+				while (true)
+				{
+					m_cond.wait(lock, [this] { return m_exit || !m_jobs.empty(); });
+					if (m_exit)
+						return;
+					//持有任务的引用 提交者在任务完成前不会返回
+					const JobPtr job = m_jobs.front();
+					if (job->next >= job->count)
+					{
+						m_jobs.pop_front();
+						continue;
+					}
+					lock.unlock();
+					Work(*job);
+					lock.lock();
+				}
+			}
+
+			std::vector<std::thread> m_threads;
+			std::deque<JobPtr> m_jobs;
+			std::mutex m_lock;
+			std::condition_variable m_cond;
+			std::condition_variable m_done;
+			bool m_exit = false;
+		};
+	}
+
+	void DMResources::EnableParallel(bool enable)
+	{
+		parallelEnabled = enable;
+	}
+
+	void DMResources::ParallelFor(_m_size count, _m_size workSize, const std::function<void(_m_size)>& proc)
+	{
+		if (count < 2 || workSize < parallelMin || !parallelEnabled || !DMWorkerPool::Get().HasWorker())
+		{
+			for (_m_size i = 0; i < count; ++i)
+				proc(i);
+			return;
+		}
+		DMWorkerPool::Get().Run(count, proc);
+	}
+
+	UIResource DMResources::EncodeChunk(UIResource src, const DMKeySchedule& schedule, bool& compressed)
+	{
+#ifdef DMRES_USE_LZ4LIB
+		//超过lz4库的最大输入尺寸时保存原数据
+		const int bound = src.size <= LZ4_MAX_INPUT_SIZE ? LZ4_compressBound((int)src.size) : 0;
+		std::vector<_m_byte> plain((size_t)bound);
+		const _m_size size = bound ? (_m_size)LZ4_compress_default((const char*)src.data, (char*)plain.data(), (int)src.size, bound) : 0;
+#else
+		std::vector<_m_byte> plain((size_t)LZ4Block_CompressBound(src.size));
+		const _m_size size = LZ4Block_Compress(src.data, src.size, plain.data(), plain.size());
+#endif // DMRES_USE_LZ4LIB
+		//压缩后不小于原数据时保存原数据 读取时通过尺寸区分
+		compressed = size != 0 && size < src.size;
+		if (compressed)
+			src = UIResource(plain.data(), size);
+		UIResource ret(new _m_byte[src.size], src.size);
+		CipherTo(src, ret.data, schedule, true);
+		return ret;
+	}
+
+	bool DMResources::DecodeChunk(const _m_byte* src, _m_size len, _m_byte* out, _m_size rawLen, const DMKeySchedule& schedule)
+	{
+		if (len > rawLen)
+			return false;
+		//未压缩的数据单元直接解密到输出
+		if (len == rawLen)
+		{
+			CipherTo({ (_m_byte*)src, len }, out, schedule, false);
+			return true;
+		}
+		std::vector<_m_byte> plain((size_t)len);
+		CipherTo({ (_m_byte*)src, len }, plain.data(), schedule, false);
+#ifdef DMRES_USE_LZ4LIB
+		return rawLen <= LZ4_MAX_INPUT_SIZE
+			&& LZ4_decompress_safe((const char*)plain.data(), (char*)out, (int)len, (int)rawLen) == (int)rawLen;
+#else
+		return LZ4Block_Decompress(plain.data(), len, out, rawLen) == rawLen;
+#endif // DMRES_USE_LZ4LIB
+	}
+
+	UIResource DMResources::EncCompressedBlocks(UIResource res, const std::wstring& key, _m_uint blocksize, const std::function<void(_m_size)>& progress)
+	{
+		const DMKeySchedule schedule = GetKeySchedule(key);
+		const _m_size count = (res.size + blocksize - 1) / blocksize;
+		std::vector<UIResource> chunks((size_t)count);
+		ParallelFor(count, res.size, [&](_m_size i)
+		{
+			const _m_size offset = i * blocksize;
+			const _m_size size = Helper::M_MIN((_m_size)blocksize, res.size - offset);
+			bool compressed = false;
+			chunks[i] = EncodeChunk({ res.data + offset, size }, schedule, compressed);
+			if (progress)
+				progress(size);
+		});
+
+		//块结束位置表
+		const _m_size tableSize = count * sizeof(_m_uint);
+		std::vector<_m_uint> ends((size_t)count);
+		_m_size pos = tableSize;
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			pos += chunks[i].size;
+			ends[i] = (_m_uint)pos;
+		}
+		UIResource ret(new _m_byte[pos], pos);
+		CipherTo({ (_m_byte*)ends.data(), tableSize }, ret.data, schedule, true);
+		pos = tableSize;
+		for (auto& chunk : chunks)
+		{
+			memcpy(ret.data + pos, chunk.data, chunk.size);
+			pos += chunk.size;
+			chunk.Release();
+		}
+		return ret;
+	}
+
+	const _m_byte* DMResources::ReadItemRange(const DMResItem& item, _m_size pos, _m_size len, std::vector<_m_byte>& buffer)
+	{
+		if (pos > item.res.size || len > item.res.size - pos)
+			return nullptr;
+		if (item.res.data)
+			return item.res.data + pos;
+		if (!item.source)
+			return nullptr;
+		buffer.resize((size_t)len);
+		return item.source->ReadAt(item.resPos.first + pos, buffer.data(), len) ? buffer.data() : nullptr;
+	}
+
+	bool DMResources::ReadChunkTable(const DMResItem& item, const DMKeySchedule& schedule, std::vector<_m_uint>& ends)
+	{
+		if (!item.blockSize)
+			return false;
+		const _m_size count = ((_m_size)item.rawSize + item.blockSize - 1) / item.blockSize;
+		const _m_size tableSize = count * sizeof(_m_uint);
+		std::vector<_m_byte> buffer;
+		const _m_byte* data = ReadItemRange(item, 0, tableSize, buffer);
+		if (!data)
+			return false;
+		ends.resize((size_t)count);
+		CipherTo({ (_m_byte*)data, tableSize }, (_m_byte*)ends.data(), schedule, false);
+
+		//每块不能超过原数据块尺寸和资源数据范围
+		_m_size pos = tableSize;
+		for (_m_size i = 0; i < count; i++)
+		{
+			const _m_size rawLen = Helper::M_MIN((_m_size)item.blockSize, item.rawSize - i * item.blockSize);
+			if (ends[i] < pos || ends[i] - pos > rawLen || ends[i] > item.res.size)
+				return false;
+			pos = ends[i];
+		}
+		return true;
+	}
+
+	bool DMResources::DecCompressed(const DMResItem& item, const std::wstring& key, _m_size offset, _m_size len, _m_byte* out)
+	{
+		if (offset > item.rawSize || len > item.rawSize - offset)
+			return false;
+		if (len == 0)
+			return true;
+		const DMKeySchedule schedule = GetKeySchedule(key);
+
+		//非块模式整个资源是一个数据单元
+		if (!item.block || !item.blockSize)
+		{
+			std::vector<_m_byte> buffer;
+			const _m_byte* data = ReadItemRange(item, 0, item.res.size, buffer);
+			if (!data)
+				return false;
+			if (offset == 0 && len == item.rawSize)
+				return DecodeChunk(data, item.res.size, out, item.rawSize, schedule);
+			std::vector<_m_byte> raw(item.rawSize);
+			if (!DecodeChunk(data, item.res.size, raw.data(), item.rawSize, schedule))
+				return false;
+			memcpy(out, raw.data() + offset, (size_t)len);
+			return true;
+		}
+
+		std::vector<_m_uint> ends;
+		if (!ReadChunkTable(item, schedule, ends))
+			return false;
+		const _m_size blockSize = item.blockSize;
+		const _m_size first = offset / blockSize;
+		const _m_size last = (offset + len - 1) / blockSize;
+		std::atomic<bool> success = true;
+		ParallelFor(last - first + 1, len, [&](_m_size i)
+		{
+			const _m_size index = first + i;
+			const _m_size from = index == 0 ? ends.size() * sizeof(_m_uint) : ends[index - 1];
+			const _m_size rawStart = index * blockSize;
+			const _m_size rawLen = Helper::M_MIN(blockSize, item.rawSize - rawStart);
+			std::vector<_m_byte> buffer;
+			const _m_byte* data = ReadItemRange(item, from, ends[index] - from, buffer);
+			if (!data)
+			{
+				success = false;
+				return;
+			}
+			//整块都在读取范围内时直接解码到输出
+			const _m_size copyStart = Helper::M_MAX(offset, rawStart);
+			const _m_size copyEnd = Helper::M_MIN(offset + len, rawStart + rawLen);
+			if (copyStart == rawStart && copyEnd == rawStart + rawLen)
+			{
+				if (!DecodeChunk(data, ends[index] - from, out + (rawStart - offset), rawLen, schedule))
+					success = false;
+				return;
+			}
+			std::vector<_m_byte> raw((size_t)rawLen);
+			if (!DecodeChunk(data, ends[index] - from, raw.data(), rawLen, schedule))
+			{
+				success = false;
+				return;
+			}
+			memcpy(out + (copyStart - offset), raw.data() + (copyStart - rawStart), (size_t)(copyEnd - copyStart));
+		});
+		return success;
+	}
+
+	_m_size DMResStream::Read(void* dst, _m_size len)
+	{
+		_m_byte* out = (_m_byte*)dst;
+		_m_size read = 0;
+		while (read < len && m_pos < m_size)
+		{
+			const _m_size index = m_pos / m_unit;
+			const std::vector<_m_byte>* unit = GetUnit(index);
+			if (!unit)
+				break;
+			const _m_size offset = m_pos - index * m_unit;
+			const _m_size size = Helper::M_MIN(len - read, (_m_size)unit->size() - offset);
+			memcpy(out + read, unit->data() + offset, size);
+			read += size;
+			m_pos += size;
+		}
+		return read;
+	}
+
+	bool DMResStream::Seek(_m_long64 offset, int origin)
+	{
+		_m_long64 pos = offset;
+		if (origin == SEEK_CUR)
+			pos += (_m_long64)m_pos;
+		else if (origin == SEEK_END)
+			pos += (_m_long64)m_size;
+		if (pos < 0 || pos > (_m_long64)m_size)
+			return false;
+		m_pos = (_m_size)pos;
+		return true;
+	}
+
+	const std::vector<_m_byte>* DMResStream::GetUnit(_m_size index)
+	{
+		for (auto iter = m_cache.begin(); iter != m_cache.end(); ++iter)
+		{
+			if (iter->first != index)
+				continue;
+			//移到最近使用的位置
+			if (iter != m_cache.begin())
+				m_cache.splice(m_cache.begin(), m_cache, iter);
+			return &m_cache.front().second;
+		}
+
+		const _m_size start = index * m_unit;
+		const _m_size size = Helper::M_MIN(m_unit, m_size - start);
+
+		//压缩资源按数据单元解码 块模式从块位置表获取单元位置
+		if (m_compress)
+		{
+			_m_size from = 0;
+			_m_size to = m_stored;
+			if (m_block)
+			{
+				if (index >= m_chunks.size())
+					return nullptr;
+				from = index == 0 ? m_chunks.size() * sizeof(_m_uint) : m_chunks[index - 1];
+				to = m_chunks[index];
+			}
+			std::vector<_m_byte> cipher((size_t)(to - from));
+			std::vector<_m_byte> data((size_t)size);
+			if (!ReadRaw(from, to - from, cipher.data())
+				|| !DMResources::DecodeChunk(cipher.data(), to - from, data.data(), size, m_schedule))
+				return nullptr;
+			m_cache.emplace_front(index, std::move(data));
+			if (m_cache.size() > cacheMax)
+				m_cache.pop_back();
+			return &m_cache.front().second;
+		}
+
+		//块模式的每个块都从初始IV开始
+		//非块模式为连续的CFB流 以前一个密文块作为IV即可从任意16字节边界开始解密
+		DMResources::DMKeySchedule schedule = m_schedule;
+		if (!m_block && start != 0 && !ReadRaw(start - sizeof(schedule.iv), sizeof(schedule.iv), schedule.iv))
+			return nullptr;
+
+		std::vector<_m_byte> data(size);
+		if (m_data)
+			DMResources::CipherTo({ (_m_byte*)m_data + start, size }, data.data(), schedule, false);
+		else
+		{
+			std::vector<_m_byte> cipher(size);
+			if (!ReadRaw(start, size, cipher.data()))
+				return nullptr;
+			DMResources::CipherTo({ cipher.data(), size }, data.data(), schedule, false);
+		}
+
+		m_cache.emplace_front(index, std::move(data));
+		if (m_cache.size() > cacheMax)
+			m_cache.pop_back();
+		return &m_cache.front().second;
+	}
+
+	bool DMResStream::ReadRaw(_m_size pos, _m_size len, _m_byte* dst)
+	{
+		if (m_data)
+		{
+			memcpy(dst, m_data + pos, len);
+			return true;
+		}
+		return m_source && m_source->ReadAt(m_dataPos + pos, dst, len);
+	}
 }
 #endif
\ No newline at end of file
@@ -21,28 +21,49 @@
 #include <Manager/Mui_ResourceMgr.h>
 #include <Render/Graphs/Mui_Render.h>
 #include <Render/Mui_RenderMgr.h>
+#include <Window/Mui_BasicWnd.h>
 #include <Mui_Helper.h>
+#include <FileSystem/Mui_FileSystem.h>
 #include <MiaoUI/src/source/ThirdParty/pugixml/pugixml.hpp>
 
 namespace Mui
 {
+	/* 图形命令字节码
+	 * "MGS"+版本号 part数量(2)
+	 * 每个part: 命令数量(2) 命令...
+	 * 每个命令: 类型(1) rc类型(1x4) rc(4x4) 颜色RGBA(1x4) value(4 float) width(4)
+	 * 多字节数值均为小端序
+	 */
+	static constexpr _m_byte GeometryCodeMagic[4] = { 'M', 'G', 'S', 1 };
+	static constexpr size_t GeometryCodeCmdSize = 33;
+
 	using namespace Helper;
 
 	UIResourceMgr::~UIResourceMgr()
 	{
+		StopPrefetch();
+		StopDecode();
+		for (auto& style : m_pinnedStyle)
+			static_cast<UIStyleImage*>(style.get())->m_pinned = nullptr;
+		m_pinnedStyle.clear();
 		m_sharedBmpList.clear();
+		m_sharedBmpLRU.clear();
 		for(auto& file : m_resList)
 		{
-			FreeResFile(file.file);
+			FreeResFile(file);
 		}
 	}
 
-	bool UIResourceMgr::AddResourcePath(std::wstring_view path, std::wstring_view key)
+	bool UIResourceMgr::AddResourcePath(std::wstring_view path, std::wstring_view key, bool mapped)
 	{
 		DMResources* dmres = new DMResources();
-		if(dmres->LoadResource(path.data(), false))
+		if(LoadResFile(dmres, path, mapped))
 		{
-			m_resList.emplace_back(resfile{ std::make_pair(dmres, key.data()), path.data() });
+			std::unique_lock lock(m_resLock);
+			m_resList.emplace_back(resfile{ std::make_pair(dmres, key.data()), path.data(), mapped });
+			AddNameDir(m_resList.size() - 1);
+			lock.unlock();
+			ReplayManifest();
 			return true;
 		}
 		delete dmres;
@@ -54,7 +75,11 @@ namespace Mui
 		DMResources* dmres = new DMResources();
 		if (dmres->LoadResource(memfile))
 		{
+			std::unique_lock lock(m_resLock);
 			m_resList.emplace_back(resfile{ std::make_pair(dmres, key.data()), L"" });
+			AddNameDir(m_resList.size() - 1);
+			lock.unlock();
+			ReplayManifest();
 			return true;
 		}
 		delete dmres;
@@ -69,51 +94,291 @@ namespace Mui
 		{
 			if (iter->path != path)
 				continue;
-			FreeResFile(iter->file);
+			//预取和解码线程可能正在读取该资源文件
+			StopPrefetch();
+			WaitDecode();
+			std::unique_lock lock(m_resLock);
+			FreeResFile(*iter);
 			m_resList.erase(iter);
+			//索引已改变 被遮盖的同名资源也需要重新加入 重建目录
+			m_nameDir.clear();
+			for (size_t i = 0; i < m_resList.size(); ++i)
+				AddNameDir(i);
 			return true;
 		}
 		return false;
 	}
 
+	bool UIResourceMgr::ReloadResource(std::wstring_view path)
+	{
+		if (path.empty())
+			return false;
+		auto file = std::find_if(m_resList.begin(), m_resList.end(),
+			[&](const resfile& res) { return res.path == path; });
+		if (file == m_resList.end())
+			return false;
+
+		//与添加时相同的读取方式 映射模式直接映射替换后的文件
+		DMResources* dmres = new DMResources();
+		if (!LoadResFile(dmres, path, file->mapped))
+		{
+			delete dmres;
+			return false;
+		}
+
+		//按内容哈希找出改变的资源 包括新增和删除的
+		std::set<std::wstring> changed;
+		//没有存储哈希的资源(v1格式)读取解密后的数据和文本计算哈希 块模式资源返回0视为改变
+		auto payloadHash = [&key = file->file.second](DMResources* res, const std::wstring& name)
+		{
+			DMResKey data = res->ReadResource(name, key);
+			_m_ulong64 hash = 0;
+			if (!data.block)
+			{
+				hash = DMResources::HashData(data.res.data, data.res.size);
+				hash = DMResources::HashData((const _m_byte*)data.resText.data(), data.resText.size() * sizeof(wchar_t), hash);
+			}
+			data.res.Release();
+			return hash;
+		};
+#if MUI_CFG_ENABLE_V2DMRES
+		std::vector<std::pair<std::wstring, _m_ulong64>> hashList;
+		std::unordered_map<std::wstring, _m_ulong64> oldHash;
+		file->file.first->EnumResourceHash(hashList);
+		for (auto& [name, hash] : hashList)
+			oldHash.emplace(std::move(name), hash);
+		dmres->EnumResourceHash(hashList);
+		for (auto& [name, hash] : hashList)
+		{
+			auto iter = oldHash.find(name);
+			if (iter == oldHash.end())
+			{
+				changed.insert(name);
+				continue;
+			}
+			_m_ulong64 oldValue = iter->second, newValue = hash;
+			oldHash.erase(iter);
+			if (!oldValue || !newValue)
+			{
+				oldValue = payloadHash(file->file.first, name);
+				newValue = payloadHash(dmres, name);
+			}
+			if (!oldValue || oldValue != newValue)
+				changed.insert(name);
+		}
+		for (const auto& [name, hash] : oldHash)
+			changed.insert(name);
+#else
+		std::vector<std::wstring> oldList, newList;
+		file->file.first->EnumResourceName(oldList);
+		dmres->EnumResourceName(newList);
+		std::set<std::wstring> oldName(oldList.begin(), oldList.end());
+		for (auto& name : newList)
+		{
+			auto iter = oldName.find(name);
+			if (iter == oldName.end())
+			{
+				changed.insert(name);
+				continue;
+			}
+			oldName.erase(iter);
+			const _m_ulong64 oldValue = payloadHash(file->file.first, name);
+			if (!oldValue || oldValue != payloadHash(dmres, name))
+				changed.insert(name);
+		}
+		changed.insert(oldName.begin(), oldName.end());
+#endif
+
+		//预取和解码线程可能正在读取旧资源文件
+		StopPrefetch();
+		WaitDecode();
+		{
+			std::lock_guard lock(m_prefetchLock);
+			for (const auto& name : changed)
+				m_prefetchDone.erase(name);
+		}
+		{
+			std::unique_lock lock(m_resLock);
+			FreeResFile(*file);
+			file->file.first = dmres;
+			m_nameDir.clear();
+			for (size_t i = 0; i < m_resList.size(); ++i)
+				AddNameDir(i);
+		}
+		if (changed.empty())
+			return true;
+		{
+			//内容改变的资源不能再用于确认相同内容的位图
+			std::lock_guard lock(m_sharedBmpLock);
+			for (auto iter = m_contentBmpList.begin(); iter != m_contentBmpList.end();)
+			{
+				if (changed.count(iter->second.name))
+					iter = m_contentBmpList.erase(iter);
+				else
+					++iter;
+			}
+		}
+
+		//先创建新对象 之后在渲染线程一次替换 绘制时不会看到只更新了一部分的状态
+		bool relayout = false;
+		std::vector<std::pair<UIBitmapPtr, Render::Def::MBitmapPtr>> bitmapList;
+		std::set<std::wstring> bitmapName;
+		{
+			std::vector<std::pair<std::wstring, UIBitmapPtr>> cacheList;
+			{
+				std::lock_guard lock(m_sharedBmpLock);
+				for (const auto& [name, data] : m_sharedBmpList)
+				{
+					if (changed.count(name) && !data.bitmap->IsLoading())
+						cacheList.emplace_back(name, data.bitmap);
+				}
+			}
+			for (auto& [name, bitmap] : cacheList)
+			{
+				//已删除的资源保留原位图
+				auto res = ReadResource(name);
+				if (!res) continue;
+				auto newBitmap = CreateContentBitmap(res, name);
+				res.Release();
+				if (!newBitmap) continue;
+
+				if (!bitmap->m_bitmap || bitmap->m_bitmap->GetSize() != newBitmap->GetSize())
+					relayout = true;
+				bitmapList.emplace_back(bitmap, newBitmap);
+				bitmapName.insert(name);
+			}
+		}
+
+		std::vector<std::pair<UIStylePtr, UIStylePtr>> styleList;
+		for (auto& [name, data] : m_styleList)
+		{
+			if (data.lazy || data.memres || !changed.count(data.srcname))
+				continue;
+			resfile* src = FindResFile(data.srcname);
+			if (!src) continue;
+			UIStylePtr style = nullptr;
+			if (!CreateStyleInternal(src->file, data.srcname, &style))
+				continue;
+
+			const auto oldImage = dynamic_cast<UIStyleImage*>(data.style.get());
+			const auto newImage = dynamic_cast<UIStyleImage*>(style.get());
+			if (!oldImage != !newImage)
+			{
+				//类型改变 无法替换原对象的内容
+				m_retiredStyle.push_back(data.style);
+				data.style = style;
+				relayout = true;
+				continue;
+			}
+			if (newImage && (newImage->m_partCount != oldImage->m_partCount
+				|| newImage->m_nineGrid != oldImage->m_nineGrid
+				|| (newImage->m_mgr && !bitmapName.count(newImage->m_cacheName))))
+				relayout = true;
+			styleList.emplace_back(data.style, style);
+		}
+
+		m_render->RunTask([&]
+		{
+			for (auto& [bitmap, newBitmap] : bitmapList)
+			{
+				std::lock_guard lock(bitmap->m_bitmapLock);
+				std::swap(bitmap->m_bitmap, newBitmap);
+			}
+			for (auto& [style, newStyle] : styleList)
+				SwapStyle(style.get(), newStyle.get());
+		});
+
+		if (!bitmapList.empty())
+		{
+			//位图尺寸可能改变 重新计算缓存字节数
+			std::lock_guard lock(m_sharedBmpLock);
+			for (const auto& name : bitmapName)
+			{
+				if (auto iter = m_sharedBmpList.find(name); iter != m_sharedBmpList.end())
+				{
+					m_bmpStats.residentBytes -= iter->second.bytes;
+					iter->second.bytes = 0;
+				}
+			}
+			TrimSharedBitmap();
+		}
+
+		if (m_window && (!bitmapList.empty() || !styleList.empty() || relayout))
+		{
+			if (relayout)
+				m_window->UpdateLayout(nullptr);
+			m_window->UpdateDisplay(nullptr);
+		}
+		return true;
+	}
+
 	UIStyle* UIResourceMgr::FindStyle(std::wstring_view name)
 	{
-		if (auto iter = m_styleList.find(name.data()); iter != m_styleList.end())
-			return iter->second.style.get();
-		return nullptr;
+		auto iter = m_styleList.find(name.data());
+		if (iter == m_styleList.end())
+			return nullptr;
+		if (iter->second.lazy && !MaterializeStyle(iter->first, iter->second))
+		{
+			m_styleList.erase(iter);
+			return nullptr;
+		}
+		return iter->second.style.get();
 	}
 
 	void UIResourceMgr::LoadStyleList()
 	{
-		for(auto& file : m_resList)
+		for (const auto& [name, index] : m_nameDir)
 		{
-			std::vector<std::wstring> list;
-			file.file.first->EnumResourceName(list);
-			for (const auto& name : list)
-			{
-				//v1通过名称前缀来确定类型
-				if (name.substr(0, 6) != L"style_")
-					continue;
-				LoadStyleInternal(file.file, name, nullptr);
-			}
+			//v1通过名称前缀来确定类型
+			if (name.compare(0, 6, L"style_") != 0)
+				continue;
+			StyleData data;
+			data.srcname = name;
+			data.lazy = true;
+			m_styleList.insert(std::make_pair(name, std::move(data)));
 		}
 	}
 
 	bool UIResourceMgr::LoadStyle(std::wstring_view resname, UIStyle** dst)
 	{
-		for (auto& file : m_resList)
+		//已登记的Style直接创建
+		if (auto iter = m_styleList.find(resname.data()); iter != m_styleList.end() && iter->second.lazy)
 		{
-			std::vector<std::wstring> list;
-			file.file.first->EnumResourceName(list);
-			for (const auto& name : list)
+			if (!MaterializeStyle(iter->first, iter->second))
 			{
-				if(name == resname)
-					return LoadStyleInternal(file.file, name, dst);
+				m_styleList.erase(iter);
+				return false;
 			}
+			if (dst)
+				*dst = iter->second.style.get();
+			return true;
 		}
+		if (resfile* file = FindResFile(resname))
+			return LoadStyleInternal(file->file, resname, dst);
 		return false;
 	}
 
+	void UIResourceMgr::PrefetchStyle(const std::vector<std::wstring>& names)
+	{
+		std::unique_lock lock(m_prefetchLock);
+		for (const auto& name : names)
+		{
+			auto iter = m_styleList.find(name);
+			if (iter == m_styleList.end() || !iter->second.lazy)
+				continue;
+			if (resfile* file = FindResFile(iter->second.srcname))
+				m_prefetchQueue.push_back({ name, file->file });
+		}
+		if (m_prefetchRunning || m_prefetchQueue.empty())
+			return;
+		m_prefetchRunning = true;
+		lock.unlock();
+		//上一个线程已处理完队列 只需回收
+		if (m_prefetchThread.joinable())
+			m_prefetchThread.join();
+		m_prefetchThread = std::thread(&UIResourceMgr::PrefetchProc, this);
+	}
+
 	bool UIResourceMgr::AddImageStyle(std::wstring_view name, UIResource memimg, _m_ushort count,
 		UIStyle** dst, bool nineGrid, _m_rect_t<int> gridpath)
 	{
@@ -134,6 +399,79 @@ namespace Mui
 		return false;
 	}
 
+	bool UIResourceMgr::AddGeometryStyle(std::wstring_view name, UIResource code, UIStyle** dst)
+	{
+		StyleData data;
+		data.memres = false;
+		if (AddGeometryCodeInternal(code, &data.style))
+		{
+			auto ret = m_styleList.insert(std::make_pair(name.data(), data));
+			if (!ret.second)
+			{
+				data.style.rest();
+				return false;
+			}
+			if (dst)
+				*dst = data.style.get();
+			return true;
+		}
+		return false;
+	}
+
+	bool UIResourceMgr::CompileGeometryStyle(std::wstring_view xml, std::vector<_m_byte>& dst)
+	{
+		UIStyleGeometry* style = new UIStyleGeometry();
+		auto clean = RAII::scope_exit([&] { style->Release(); });
+		if (!ParseGeometryXML(xml, style))
+			return false;
+
+		auto Write = [&dst](_m_uint value, int bytes)
+		{
+			for (int i = 0; i < bytes; ++i)
+				dst.push_back((_m_byte)(value >> (i * 8)));
+		};
+
+		dst.clear();
+		dst.insert(dst.end(), std::begin(GeometryCodeMagic), std::end(GeometryCodeMagic));
+		Write(style->m_partCount, 2);
+		for (const auto& part : style->m_cmdlist)
+		{
+			Write((_m_uint)part.size(), 2);
+			for (const auto& cmd : part)
+			{
+				Write((_m_uint)cmd.type, 1);
+				for (auto rctype : cmd.m_rctype)
+					Write(rctype, 1);
+				Write((_m_uint)cmd.m_dst.left, 4);
+				Write((_m_uint)cmd.m_dst.top, 4);
+				Write((_m_uint)cmd.m_dst.right, 4);
+				Write((_m_uint)cmd.m_dst.bottom, 4);
+				Write(cmd.color.r, 1);
+				Write(cmd.color.g, 1);
+				Write(cmd.color.b, 1);
+				Write(cmd.color.a, 1);
+				_m_uint param = 0;
+				memcpy(&param, &cmd.param, sizeof(float));
+				Write(param, 4);
+				Write((_m_uint)cmd.width, 4);
+			}
+		}
+		return true;
+	}
+
+	UIStyleParseStats UIResourceMgr::GetStyleParseStats()
+	{
+		std::lock_guard lock(m_statsLock);
+		const auto& xml = m_opStats[(size_t)UIResourceOp::GeometryStyle];
+		const auto& code = m_opStats[(size_t)UIResourceOp::GeometryCode];
+		UIStyleParseStats ret;
+		ret.xmlCount = xml.count - xml.fails;
+		ret.xmlTime = xml.time;
+		ret.codeCount = code.count - code.fails;
+		ret.codeTime = code.time;
+		return ret;
+	}
+
 	bool UIResourceMgr::AddGeometryStyle(std::wstring_view name, std::wstring_view xml, UIStyle** dst)
 	{
 		StyleData data;
@@ -156,9 +494,20 @@ namespace Mui
 	UIStyle* UIResourceMgr::RemoveStyle(std::wstring_view resname)
 	{
 		auto iter = m_styleList.find(resname.data());
+		if (iter != m_styleList.end() && iter->second.lazy && !MaterializeStyle(iter->first, iter->second))
+		{
+			m_styleList.erase(iter);
+			return nullptr;
+		}
 		if (iter != m_styleList.end())
 		{
 			auto style = iter->second.style;
+			//不再受资源管理器管理 直接持有位图
+			if (const auto image = dynamic_cast<UIStyleImage*>(style.get()); image && image->m_mgr)
+			{
+				image->m_bitmap = CreateSharedUIBitmap(image->m_cacheName);
+				image->m_mgr = nullptr;
+			}
 			style->AddRef();
 			m_styleList.erase(iter);
 			return style.get();
@@ -168,13 +517,15 @@ namespace Mui
 
 	UIResource UIResourceMgr::ReadResource(std::wstring_view name)
 	{
-		for (auto& file : m_resList)
+		const auto begin = std::chrono::steady_clock::now();
+		UIResource ret;
 		{
-			UIResource res = file.file.first->ReadResource(name.data(), file.file.second, DataRes).res;
-			if (res.data)
-				return res;
+			std::shared_lock lock(m_resLock);
+			if (resfile* file = FindResFile(name))
+				ret = file->file.first->ReadResource(name.data(), file->file.second, DataRes).res;
 		}
-		return {};
+		TraceOp(UIResourceOp::ReadResource, name, begin, ret.size, ret.data != nullptr);
+		return ret;
 	}
 
 	UIBitmapPtr UIResourceMgr::CreateUniqueUIBitamp(std::wstring_view name)
@@ -189,7 +540,7 @@ namespace Mui
 	{
 		if (!res) return nullptr;
 
-		const auto bitmap = m_render->CreateBitmap(res);
+		const auto bitmap = DecodeBitmap(res, {});
 		if (!bitmap) return nullptr;
 
 		const auto bmp = new UIBitmap();
@@ -200,25 +551,519 @@ namespace Mui
 
 	UIBitmapPtr UIResourceMgr::CreateSharedUIBitmap(std::wstring_view name)
 	{
-		auto iter = m_sharedBmpList.find(name.data());
-		if (iter != m_sharedBmpList.end())
-			return iter->second;
+		RecordManifest(false, name);
+		const std::wstring key = name.data();
+		{
+			std::lock_guard lock(m_sharedBmpLock);
+			if (auto ret = FindSharedBitmap(key))
+				return ret;
+		}
 
+		const auto begin = std::chrono::steady_clock::now();
 		auto res = ReadResource(name);
-		if (!res) return nullptr;
+		if (!res)
+		{
+			TraceOp(UIResourceOp::SharedBitmap, name, begin, 0, false);
+			return nullptr;
+		}
 
-		const auto bitmap = m_render->CreateBitmap(res);
+		const _m_size bytes = res.size;
+		const auto bitmap = CreateContentBitmap(res, name);
 		res.Release();
+		AddSyncLoadTime(begin);
+		TraceOp(UIResourceOp::SharedBitmap, name, begin, bytes, bitmap.get() != nullptr);
 		if (!bitmap) return nullptr;
 
-		const auto ret = new UIBitmap();
+		UIBitmapPtr ret = new UIBitmap();
 		ret->m_bitmap = bitmap;
 
-		m_sharedBmpList[name.data()] = ret;
+		return AddSharedBitmap(key, ret);
+	}
+
+	UIBitmapPtr UIResourceMgr::CreateSharedUIBitmapAsync(std::wstring_view name)
+	{
+		RecordManifest(false, name);
+		const std::wstring key = name.data();
+		{
+			std::lock_guard lock(m_sharedBmpLock);
+			if (auto ret = FindSharedBitmap(key))
+				return ret;
+		}
 
+		auto ret = LoadUIBitmapAsync(name, true);
+		if (ret)
+			ret = AddSharedBitmap(key, ret);
 		return ret;
 	}
 
+	void UIResourceMgr::SetBitmapCacheBudget(_m_size bytes)
+	{
+		std::lock_guard lock(m_sharedBmpLock);
+		m_bmpStats.budget = bytes;
+		TrimSharedBitmap();
+	}
+
+	UIBitmapCacheStats UIResourceMgr::GetBitmapCacheStats()
+	{
+		std::lock_guard lock(m_sharedBmpLock);
+		m_bmpStats.count = m_sharedBmpList.size();
+		m_bmpStats.uniqueBytes = 0;
+		std::set<Render::Def::MBitmap*> counted;
+		for (const auto& [name, data] : m_sharedBmpList)
+		{
+			const auto bitmap = data.bitmap->GetBitmap();
+			if (!bitmap || !counted.insert(bitmap.get()).second)
+				continue;
+			const UISize size = bitmap->GetSize();
+			m_bmpStats.uniqueBytes += (_m_size)size.width * (_m_size)size.height * 4;
+		}
+		for (const auto& [page, bytes] : m_atlasPage)
+			m_bmpStats.uniqueBytes += bytes;
+		return m_bmpStats;
+	}
+
+	Render::Def::MBitmapPtr UIResourceMgr::CreateContentBitmap(UIResource res, std::wstring_view name)
+	{
+		if (!res) return nullptr;
+
+		//哈希和尺寸相同时重新读取已有位图的来源资源比较内容 冲突的位图不复用也不替换已有的
+		//读取资源耗时 比较时不持有m_sharedBmpLock
+		auto Same = [this, &res](const std::wstring& srcName)
+		{
+			UIResource src = ReadResource(srcName);
+			const bool same = src.size == res.size && memcmp(src.data, res.data, res.size) == 0;
+			src.Release();
+			return same;
+		};
+		auto Reuse = [this](const ContentBitmap& content)
+		{
+			std::lock_guard lock(m_sharedBmpLock);
+			m_bmpStats.dedupHits++;
+			return content.bitmap;
+		};
+		const auto key = std::make_pair(DMResources::HashData(res.data, res.size), res.size);
+		ContentBitmap found;
+		{
+			std::lock_guard lock(m_sharedBmpLock);
+			if (auto iter = m_contentBmpList.find(key); iter != m_contentBmpList.end())
+				found = iter->second;
+		}
+		if (found.bitmap && Same(found.name))
+			return Reuse(found);
+
+		auto bitmap = DecodeBitmap(res, name);
+		if (!bitmap) return nullptr;
+
+		std::unique_lock lock(m_sharedBmpLock);
+		auto [iter, success] = m_contentBmpList.try_emplace(key);
+		if (success)
+		{
+			iter->second.bitmap = bitmap;
+			iter->second.name = name;
+			return bitmap;
+		}
+		//其他线程已创建相同内容的位图 已比较过的不再重复读取
+		const ContentBitmap other = iter->second;
+		lock.unlock();
+		if (other.bitmap.get() != found.bitmap.get() && Same(other.name))
+			return Reuse(other);
+		return bitmap;
+	}
+
+	_m_uint UIResourceMgr::BuildStyleAtlas(_m_uint pageSize, _m_uint maxSize)
+	{
+		//图集中图像之间保留1像素间隔 避免缩放采样时混入相邻图像
+		constexpr int padding = 1;
+		const int pageEdge = (int)pageSize;
+
+		struct AtlasItem
+		{
+			UIStyleImage* style = nullptr;
+			UIBitmapPtr bitmap = nullptr;
+			UISize size;
+			size_t page = 0;
+			UIPoint pos;
+		};
+		std::vector<AtlasItem> itemList;
+		for (auto& [name, data] : m_styleList)
+		{
+			if (data.lazy) continue;
+			const auto style = dynamic_cast<UIStyleImage*>(data.style.get());
+			if (!style || !style->m_atlasRect.IsEmpty())
+				continue;
+
+			UIBitmapPtr bitmap = style->m_bitmap;
+			if (!bitmap && style->m_mgr)
+				bitmap = CreateSharedUIBitmap(style->m_cacheName);
+			if (!bitmap || !bitmap->GetBitmap())
+				continue;
+
+			const UISize size = bitmap->GetBitmap()->GetSize();
+			if (size.width <= 0 || size.height <= 0 || size.width > (int)maxSize || size.height > (int)maxSize
+				|| size.width + padding > pageEdge || size.height + padding > pageEdge)
+				continue;
+
+			AtlasItem item;
+			item.style = style;
+			item.bitmap = bitmap;
+			item.size = size;
+			itemList.push_back(item);
+		}
+		if (itemList.size() < 2)
+			return 0;
+
+		//按高度从大到小放置 天际线的高度更平整
+		std::sort(itemList.begin(), itemList.end(), [](const AtlasItem& a, const AtlasItem& b)
+		{
+			return a.size.height != b.size.height ? a.size.height > b.size.height : a.size.width > b.size.width;
+		});
+
+		//天际线装箱 每页记录从左到右连续覆盖页宽的线段
+		struct Segment
+		{
+			int x = 0;
+			int y = 0;
+			int width = 0;
+		};
+		std::vector<std::vector<Segment>> skylineList;
+
+		auto PlaceItem = [pageEdge](std::vector<Segment>& skyline, int width, int height, UIPoint& pt)
+		{
+			size_t best = skyline.size();
+			int bestX = 0, bestY = pageEdge;
+			for (size_t i = 0; i < skyline.size(); ++i)
+			{
+				const int x = skyline[i].x;
+				if (x + width > pageEdge)
+					break;
+				//放在该位置时的底边为跨越的线段中最高的一段
+				int y = 0;
+				for (size_t j = i; j < skyline.size() && skyline[j].x < x + width; ++j)
+					y = M_MAX(y, skyline[j].y);
+				if (y + height <= pageEdge && y < bestY)
+				{
+					best = i;
+					bestX = x;
+					bestY = y;
+				}
+			}
+			if (best == skyline.size())
+				return false;
+
+			//新线段覆盖被占用的部分 后面的线段被截断或移除
+			skyline.insert(skyline.begin() + (ptrdiff_t)best, { bestX, bestY + height, width });
+			for (size_t i = best + 1; i < skyline.size() && skyline[i].x < bestX + width;)
+			{
+				const int overlap = bestX + width - skyline[i].x;
+				if (overlap >= skyline[i].width)
+				{
+					skyline.erase(skyline.begin() + (ptrdiff_t)i);
+					continue;
+				}
+				skyline[i].x += overlap;
+				skyline[i].width -= overlap;
+				break;
+			}
+			//合并相同高度的相邻线段
+			for (size_t i = 0; i + 1 < skyline.size();)
+			{
+				if (skyline[i].y == skyline[i + 1].y)
+				{
+					skyline[i].width += skyline[i + 1].width;
+					skyline.erase(skyline.begin() + (ptrdiff_t)i + 1);
+				}
+				else
+					++i;
+			}
+			pt = { bestX, bestY };
+			return true;
+		};
+
+		for (auto& item : itemList)
+		{
+			const int width = item.size.width + padding;
+			const int height = item.size.height + padding;
+			bool placed = false;
+			for (size_t i = 0; i < skylineList.size() && !placed; ++i)
+			{
+				if (PlaceItem(skylineList[i], width, height, item.pos))
+				{
+					item.page = i;
+					placed = true;
+				}
+			}
+			if (!placed)
+			{
+				skylineList.push_back({ { 0, 0, pageEdge } });
+				PlaceItem(skylineList.back(), width, height, item.pos);
+				item.page = skylineList.size() - 1;
+			}
+		}
+
+		/* 按实际使用的区域创建图集页 并复制图像内容
+		 * 同一页的Style共用源位图 绘制时仍逐个DrawBitmap 当前GDI+渲染器未实现MBatchBitmap
+		 */
+		_m_uint pageCount = 0;
+		for (size_t i = 0; i < skylineList.size(); ++i)
+		{
+			int pageWidth = 0, pageHeight = 0, itemCount = 0;
+			for (const auto& item : itemList)
+			{
+				if (item.page != i) continue;
+				pageWidth = M_MAX(pageWidth, item.pos.x + item.size.width);
+				pageHeight = M_MAX(pageHeight, item.pos.y + item.size.height);
+				itemCount++;
+			}
+			//只有一个图像的页没有意义
+			if (itemCount < 2)
+				continue;
+
+			const _m_uint stride = (_m_uint)pageWidth * 4;
+			std::vector<_m_byte> pixel((size_t)stride * pageHeight, 0);
+			auto pageBmp = m_render->CreateBitmap(pageWidth, pageHeight, pixel.data(), (_m_uint)pixel.size(), stride);
+			if (!pageBmp)
+				continue;
+
+			UIBitmapPtr page = new UIBitmap();
+			page->m_bitmap = pageBmp;
+
+			for (auto& item : itemList)
+			{
+				if (item.page != i) continue;
+				const _m_rect srcRect = { 0, 0, item.size.width, item.size.height };
+				if (!m_render->CopyBitmapContent(pageBmp.get(), item.bitmap->GetBitmap().get(), item.pos, srcRect))
+					continue;
+
+				item.style->m_bitmap = page;
+				item.style->m_mgr = nullptr;
+				item.style->m_atlasRect = { item.pos.x, item.pos.y,
+					item.pos.x + item.size.width, item.pos.y + item.size.height };
+			}
+			std::lock_guard lock(m_sharedBmpLock);
+			const _m_size bytes = (_m_size)stride * (_m_size)pageHeight;
+			m_atlasPage.emplace_back(page, bytes);
+			m_bmpStats.residentBytes += bytes;
+			pageCount++;
+		}
+		//打包的Style不再引用原来的共享位图 可以被淘汰
+		if (pageCount != 0)
+		{
+			itemList.clear();
+			std::lock_guard lock(m_sharedBmpLock);
+			TrimSharedBitmap();
+		}
+		return pageCount;
+	}
+
+	UIBitmapPtr UIResourceMgr::FindSharedBitmap(const std::wstring& name)
+	{
+		auto iter = m_sharedBmpList.find(name);
+		if (iter == m_sharedBmpList.end())
+		{
+			m_bmpStats.misses++;
+			return nullptr;
+		}
+		m_bmpStats.hits++;
+		m_sharedBmpLRU.splice(m_sharedBmpLRU.begin(), m_sharedBmpLRU, iter->second.lru);
+		return iter->second.bitmap;
+	}
+
+	UIBitmapPtr UIResourceMgr::AddSharedBitmap(const std::wstring& name, UIBitmapPtr bitmap)
+	{
+		std::lock_guard lock(m_sharedBmpLock);
+		//加载期间其他线程已添加同名位图
+		if (auto iter = m_sharedBmpList.find(name); iter != m_sharedBmpList.end())
+			return iter->second.bitmap;
+
+		m_sharedBmpLRU.push_front(name);
+		SharedBitmap& data = m_sharedBmpList[name];
+		data.bitmap = bitmap;
+		data.lru = m_sharedBmpLRU.begin();
+		TrimSharedBitmap();
+		return bitmap;
+	}
+
+	void UIResourceMgr::TrimSharedBitmap()
+	{
+		//图集页不被淘汰 只在不再被Style引用时移除
+		for (size_t i = 0; i < m_atlasPage.size();)
+		{
+			if (m_atlasPage[i].first->GetRefCount() > 1)
+			{
+				++i;
+				continue;
+			}
+			m_bmpStats.residentBytes -= m_atlasPage[i].second;
+			m_atlasPage.erase(m_atlasPage.begin() + (ptrdiff_t)i);
+		}
+		//异步加载的位图完成后才能计算尺寸
+		for (auto& [name, data] : m_sharedBmpList)
+		{
+			if (data.bytes != 0)
+				continue;
+			if (const auto bitmap = data.bitmap->GetBitmap())
+			{
+				const UISize size = bitmap->GetSize();
+				data.bytes = (_m_size)size.width * (_m_size)size.height * 4;
+				m_bmpStats.residentBytes += data.bytes;
+			}
+		}
+		//从最久未使用的开始淘汰 仍被其他对象引用或正在加载的跳过 预算为0时不淘汰
+		auto iter = m_sharedBmpLRU.end();
+		while (m_bmpStats.budget != 0 && iter != m_sharedBmpLRU.begin() && m_bmpStats.residentBytes > m_bmpStats.budget)
+		{
+			--iter;
+			auto data = m_sharedBmpList.find(*iter);
+			if (data->second.bitmap->GetRefCount() > 1 || data->second.bitmap->IsLoading())
+				continue;
+			m_bmpStats.residentBytes -= data->second.bytes;
+			m_bmpStats.evictions++;
+			m_sharedBmpList.erase(data);
+			iter = m_sharedBmpLRU.erase(iter);
+		}
+		//被淘汰或被替换的位图不再有其他引用
+		for (auto content = m_contentBmpList.begin(); content != m_contentBmpList.end();)
+		{
+			if (content->second.bitmap->GetRefCount() <= 1)
+				content = m_contentBmpList.erase(content);
+			else
+				++content;
+		}
+	}
+
+	void UIResourceMgr::BeginFrame()
+	{
+		m_paintFrame++;
+		bool released = false;
+		for (size_t i = 0; i < m_pinnedStyle.size();)
+		{
+			const auto image = static_cast<UIStyleImage*>(m_pinnedStyle[i].get());
+			//上一帧绘制过的继续持有
+			if (image->m_pinned && image->m_pinFrame + 1 >= m_paintFrame)
+			{
+				++i;
+				continue;
+			}
+			image->m_pinned = nullptr;
+			image->m_pinListed = false;
+			m_pinnedStyle[i] = std::move(m_pinnedStyle.back());
+			m_pinnedStyle.pop_back();
+			released = true;
+		}
+		if (!released)
+			return;
+		std::lock_guard lock(m_sharedBmpLock);
+		TrimSharedBitmap();
+	}
+
+	UIBitmapPtr UIResourceMgr::CreateUniqueUIBitampAsync(std::wstring_view name)
+	{
+		return LoadUIBitmapAsync(name, false);
+	}
+
+	UIBitmapPtr UIResourceMgr::LoadUIBitmapAsync(std::wstring_view name, bool shared)
+	{
+		//名称目录可能正在被ReloadResource重建 查找和复制资源文件句柄时持有共享锁
+		MUIRESFILE res;
+		{
+			std::shared_lock lock(m_resLock);
+			resfile* file = FindResFile(name);
+			if (!file)
+				return nullptr;
+			res = file->file;
+		}
+
+		UIBitmapPtr ret = new UIBitmap();
+		ret->m_loading = true;
+
+		std::unique_lock lock(m_decodeLock);
+		m_decodeQueue.emplace_back([this, bmp = ret, res, name = std::wstring(name), shared]
+		{
+			//解密在解码线程完成 位图创建由MRenderCmd转到渲染线程
+			const auto begin = std::chrono::steady_clock::now();
+			UIResource data;
+			try
+			{
+				data = res.first->ReadResource(name, res.second, DataRes).res;
+				TraceOp(UIResourceOp::ReadResource, name, begin, data.size, data.data != nullptr);
+				if (data)
+					bmp->m_bitmap = shared ? CreateContentBitmap(data, name) : DecodeBitmap(data, name);
+			}
+			//异常不能离开解码线程 与读取失败相同 位图保持为空
+			catch (...)
+			{
+				bmp->m_bitmap = nullptr;
+			}
+			data.Release();
+			bmp->m_loading = false;
+		});
+		if (m_decodeThreads.empty())
+		{
+			const _m_uint count = M_MAX(M_MIN(std::thread::hardware_concurrency() / 2, 4u), 1u);
+			m_decodeStop = false;
+			for (_m_uint i = 0; i < count; ++i)
+				m_decodeThreads.emplace_back(&UIResourceMgr::DecodeProc, this);
+		}
+		lock.unlock();
+		m_decodeSignal.notify_one();
+		return ret;
+	}
+
+	void UIResourceMgr::DecodeProc()
+	{
+		std::unique_lock lock(m_decodeLock);
+		while (true)
+		{
+			m_decodeSignal.wait(lock, [this] { return m_decodeStop || !m_decodeQueue.empty(); });
+			if (m_decodeQueue.empty())
+				return;
+
+			auto task = std::move(m_decodeQueue.front());
+			m_decodeQueue.pop_front();
+			m_decodeActive++;
+			lock.unlock();
+
+			//任务抛出异常时仍需减少计数 否则WaitDecode不会返回
+			try
+			{
+				task();
+			}
+			catch (...) {}
+
+			lock.lock();
+			m_decodeActive--;
+			const bool idle = m_decodeQueue.empty() && m_decodeActive == 0;
+			if (idle)
+				m_decodeIdle.notify_all();
+			if (!m_window || m_decodeStop)
+				continue;
+			//全部完成后重新布局一次 自动尺寸的控件需要位图尺寸 其余情况只需重绘
+			lock.unlock();
+			if (idle)
+				m_window->PostLayout();
+			m_window->UpdateDisplay(nullptr);
+			lock.lock();
+		}
+	}
+
+	void UIResourceMgr::WaitDecode()
+	{
+		std::unique_lock lock(m_decodeLock);
+		m_decodeIdle.wait(lock, [this] { return m_decodeQueue.empty() && m_decodeActive == 0; });
+	}
+
+	void UIResourceMgr::StopDecode()
+	{
+		{
+			std::lock_guard lock(m_decodeLock);
+			m_decodeStop = true;
+		}
+		m_decodeSignal.notify_all();
+		for (auto& thread : m_decodeThreads)
+			thread.join();
+		m_decodeThreads.clear();
+	}
+
 	bool UIResourceMgr::LoadStyleFromDMRes(MUIRESFILE& file, std::wstring_view name, std::wstring& dst, bool res, UIResource* dstres)
 	{
 		auto reskey = file.first->ReadResource(name.data(), file.second, res ? AllRes : StringRes);
@@ -227,21 +1072,49 @@ namespace Mui
 			reskey.res.Release();
 			return false;
 		}
-		if (res)
-			*dstres = reskey.res;
-		dst = reskey.resText;
-		dst = M_ReplaceString(dst, L"\r\n", L"\n");
-		dst = M_ReplaceString(dst, L"\r", L"\n");
-
+		if (res)
+			*dstres = reskey.res;
+		dst = reskey.resText;
+		dst = M_ReplaceString(dst, L"\r\n", L"\n");
+		dst = M_ReplaceString(dst, L"\r", L"\n");
+
+		return true;
+	}
+
+	bool UIResourceMgr::LoadStyleInternal(MUIRESFILE& file, std::wstring_view name, UIStyle** dststyle)
+	{
+		StyleData data;
+		data.memres = false;
+		data.srcname = name;
+		RecordManifest(true, name);
+		const auto begin = std::chrono::steady_clock::now();
+		const bool created = CreateStyleInternal(file, name, &data.style);
+		AddSyncLoadTime(begin);
+		if (!created)
+			return false;
+		//重名
+		if (auto [iter, success] = m_styleList.insert(std::make_pair(name, data)); !success)
+		{
+			data.style.rest();
+			return false;
+		}
+		if (dststyle)
+			*dststyle = data.style.get();
 		return true;
 	}
 
-	bool UIResourceMgr::LoadStyleInternal(MUIRESFILE& file, std::wstring_view name, UIStyle** dststyle)
+	bool UIResourceMgr::CreateStyleInternal(MUIRESFILE& file, std::wstring_view name, UIStyle** dststyle)
 	{
+		//调用方传入的dststyle均为空指针 创建成功后才会写入
+		const auto begin = std::chrono::steady_clock::now();
+		_m_size bytes = 0;
+		auto trace = RAII::scope_exit([&] { TraceOp(UIResourceOp::LoadStyle, name, begin, bytes, *dststyle != nullptr); });
+
 		std::wstring dst;
 		UIResource res;
 		if (!LoadStyleFromDMRes(file, name, dst, true, &res))
 			return false;
+		bytes = res.size + dst.size() * sizeof(wchar_t);
 
 		auto clean = RAII::scope_exit([&] { res.Release(); });
 
@@ -261,15 +1134,22 @@ namespace Mui
 		 * StyleGeometry
 		 * 2 - 类型
 		 * xml ....
+		 *
+		 * StyleGeometry字节码
+		 * 3 - 类型
+		 * 字节码大小 - 资源数据为CompileGeometryStyle生成的字节码
 		 */
 
 		auto type = M_StoInt(M_GetTextLine(dst, 1));
-		if (type < 1 || type > 2)
+		if (type < 1 || type > 3)
 			return false;
 
-		StyleData data;
-		data.memres = false;
-		data.srcname = name;
+		if (type == 3)
+		{
+			if ((_m_size)M_StoInt(M_GetTextLine(dst, 2)) != res.size)
+				return false;
+			return AddGeometryCodeInternal(res, dststyle);
+		}
 
 		if (type == 1)
 		{
@@ -286,36 +1166,482 @@ namespace Mui
 				M_GetAttribValueInt(M_GetTextLine(dst, 3), dstValue, 4);
 				gridpath = { dstValue[0], dstValue[1], dstValue[2], dstValue[3] };
 			}
-			if (!AddImageStyleInternal(res, count, &data.style, nineGrid, gridpath))
-				return false;
+			return AddImageStyleInternal(res, count, dststyle, nineGrid, gridpath, name);
+		}
+		auto start = dst.find('\n');
+		dst = dst.substr(start, dst.length() - start);
+		return AddGeometryStyleInternal(dst, dststyle);
+	}
+
+	bool UIResourceMgr::MaterializeStyle(const std::wstring& name, StyleData& data)
+	{
+		RecordManifest(true, data.srcname);
+		const auto begin = std::chrono::steady_clock::now();
+		auto addTime = RAII::scope_exit([&] { AddSyncLoadTime(begin); });
+		{
+			//正在预取时等待完成 仍在队列中的直接移除
+			std::unique_lock lock(m_prefetchLock);
+			m_prefetchSignal.wait(lock, [&] { return m_prefetchCur != name; });
+			if (auto iter = m_prefetchDone.find(name); iter != m_prefetchDone.end())
+			{
+				data.style = std::move(iter->second);
+				m_prefetchDone.erase(iter);
+				m_prefetchHits++;
+			}
+			else
+			{
+				m_prefetchQueue.erase(std::remove_if(m_prefetchQueue.begin(), m_prefetchQueue.end(),
+					[&](const PrefetchItem& item) { return item.name == name; }), m_prefetchQueue.end());
+			}
 		}
-		else if (type == 2)
+		if (!data.style)
 		{
-			auto start = dst.find('\n');
-			dst = dst.substr(start, dst.length() - start);
-			if (!AddGeometryStyleInternal(dst, &data.style))
+			resfile* file = FindResFile(data.srcname);
+			if (!file || !CreateStyleInternal(file->file, data.srcname, &data.style))
 				return false;
 		}
-		//重名
-		if (auto [iter, success] = m_styleList.insert(std::make_pair(name, data)); !success)
+		data.lazy = false;
+		return true;
+	}
+
+	void UIResourceMgr::PrefetchProc()
+	{
+		std::unique_lock lock(m_prefetchLock);
+		while (!m_prefetchQueue.empty())
+		{
+			PrefetchItem item = std::move(m_prefetchQueue.front());
+			m_prefetchQueue.pop_front();
+			m_prefetchCur = item.name;
+			lock.unlock();
+
+			UIStylePtr style = nullptr;
+			CreateStyleInternal(item.file, item.name, &style);
+
+			lock.lock();
+			if (style)
+				m_prefetchDone[item.name] = std::move(style);
+			m_prefetchCur.clear();
+			m_prefetchSignal.notify_all();
+		}
+		m_prefetchRunning = false;
+	}
+
+	void UIResourceMgr::BeginRecordManifest(_m_uint duration)
+	{
+		std::lock_guard lock(m_manifestLock);
+		m_manifestRecord.clear();
+		m_manifestRecorded.clear();
+		m_manifestEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(duration);
+		m_manifestRecording = true;
+	}
+
+	bool UIResourceMgr::SaveManifest(std::wstring_view path)
+	{
+		std::string text;
+		{
+			std::lock_guard lock(m_manifestLock);
+			for (const auto& item : m_manifestRecord)
+			{
+				text += item.style ? "s " : "b ";
+				text += M_WStringToString(item.name);
+				text += "\n";
+			}
+		}
+		const UIResource res((_m_byte*)text.data(), (_m_size)text.size());
+		try
+		{
+			return FS::MWriteFile(path, res) == res.size;
+		}
+		catch (const MError&)
 		{
-			data.style.rest();
 			return false;
 		}
-		if (dststyle)
-			*dststyle = data.style.get();
+	}
+
+	bool UIResourceMgr::LoadManifest(std::wstring_view path)
+	{
+		UIResource res;
+		try
+		{
+			res = FS::MReadFile(path, true);
+		}
+		catch (const MError&)
+		{
+			return false;
+		}
+		if (!res.data)
+			return false;
+
+		const std::wstring text = M_StringToWString((const char*)res.data);
+		res.Release();
+		size_t pos = 0;
+		while (pos < text.length())
+		{
+			size_t end = text.find(L'\n', pos);
+			if (end == std::wstring::npos)
+				end = text.length();
+			std::wstring_view line(text.data() + pos, end - pos);
+			if (!line.empty() && line.back() == L'\r')
+				line.remove_suffix(1);
+			if (line.length() > 2 && (line[0] == L's' || line[0] == L'b') && line[1] == L' ')
+				m_manifestPending.push_back({ line[0] == L's', std::wstring(line.substr(2)) });
+			pos = end + 1;
+		}
+		ReplayManifest();
 		return true;
 	}
 
+	UIResourceLoadStats UIResourceMgr::GetLoadStats()
+	{
+		UIResourceLoadStats ret;
+		ret.syncCount = m_syncLoadCount;
+		ret.syncTime = m_syncLoadTime;
+		ret.prefetchHits = m_prefetchHits;
+		ret.manifestCount = m_manifestCount;
+		return ret;
+	}
+
+	void UIResourceMgr::RecordManifest(bool style, std::wstring_view name)
+	{
+		if (!m_manifestRecording)
+			return;
+		std::lock_guard lock(m_manifestLock);
+		if (std::chrono::steady_clock::now() > m_manifestEnd)
+		{
+			m_manifestRecording = false;
+			return;
+		}
+		//同一名称只记录第一次使用的方式 图像Style绘制时获取位图不会重复记录
+		if (m_manifestRecorded.emplace(name).second)
+			m_manifestRecord.push_back({ style, std::wstring(name) });
+	}
+
+	void UIResourceMgr::ReplayManifest()
+	{
+		if (m_manifestPending.empty())
+			return;
+
+		std::vector<std::wstring> styleList;
+		std::vector<ManifestItem> remain;
+		for (auto& item : m_manifestPending)
+		{
+			if (!FindResFile(item.name))
+			{
+				remain.push_back(std::move(item));
+				continue;
+			}
+			if (item.style)
+			{
+				//未登记的Style先登记为延迟创建 再交给预取线程
+				if (auto [iter, success] = m_styleList.try_emplace(item.name); success)
+				{
+					iter->second.srcname = item.name;
+					iter->second.lazy = true;
+				}
+				styleList.push_back(item.name);
+			}
+			else
+			{
+				//不经过CreateSharedUIBitmapAsync 预取不应被记录为使用
+				bool cached;
+				{
+					std::lock_guard lock(m_sharedBmpLock);
+					cached = m_sharedBmpList.find(item.name) != m_sharedBmpList.end();
+				}
+				if (!cached)
+				{
+					if (auto bitmap = LoadUIBitmapAsync(item.name, true))
+						AddSharedBitmap(item.name, bitmap);
+				}
+			}
+			m_manifestCount++;
+		}
+		m_manifestPending = std::move(remain);
+		if (!styleList.empty())
+			PrefetchStyle(styleList);
+	}
+
+	void UIResourceMgr::AddSyncLoadTime(std::chrono::steady_clock::time_point begin)
+	{
+		m_syncLoadCount++;
+		m_syncLoadTime += (_m_size)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - begin).count();
+	}
+
+	void UIResourceMgr::TraceOp(UIResourceOp op, std::wstring_view name, std::chrono::steady_clock::time_point begin,
+		_m_size bytes, bool success)
+	{
+		const auto time = (_m_size)std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - begin).count();
+
+		decltype(m_traceCallback) callback;
+		{
+			std::lock_guard lock(m_statsLock);
+			auto& stats = m_opStats[(size_t)op];
+			stats.count++;
+			stats.time += time;
+			stats.maxTime = M_MAX(stats.maxTime, time);
+			stats.bytes += bytes;
+			if (!success)
+			{
+				stats.fails++;
+				if (op == UIResourceOp::ReadResource && !name.empty() && m_missNames.size() < 256
+					&& std::find(m_missNames.begin(), m_missNames.end(), name) == m_missNames.end())
+					m_missNames.emplace_back(name);
+			}
+			callback = m_traceCallback;
+		}
+		//在锁外调用 回调耗时不影响其他线程
+		if (callback)
+		{
+			UIResourceTraceEvent event;
+			event.op = op;
+			event.name = name;
+			event.time = time;
+			event.bytes = bytes;
+			event.success = success;
+			(*callback)(event);
+		}
+	}
+
+	Render::Def::MBitmapPtr UIResourceMgr::DecodeBitmap(UIResource res, std::wstring_view name)
+	{
+		const auto begin = std::chrono::steady_clock::now();
+		auto bitmap = m_render->CreateBitmap(res);
+		TraceOp(UIResourceOp::DecodeBitmap, name, begin, res.size, bitmap.get() != nullptr);
+		return bitmap;
+	}
+
+	UIResourceStats UIResourceMgr::GetStats()
+	{
+		UIResourceStats ret;
+		{
+			std::shared_lock lock(m_resLock);
+			ret.resFileCount = m_resList.size();
+			ret.nameCount = m_nameDir.size();
+		}
+		ret.styleCount = m_styleList.size();
+		for (const auto& [name, data] : m_styleList)
+		{
+			if (data.lazy)
+				ret.lazyStyleCount++;
+			else if (dynamic_cast<UIStyleImage*>(data.style.get()))
+				ret.imageStyleCount++;
+			else if (dynamic_cast<UIStyleGeometry*>(data.style.get()))
+				ret.geometryStyleCount++;
+		}
+		ret.bitmapCache = GetBitmapCacheStats();
+		ret.load = GetLoadStats();
+
+		std::lock_guard lock(m_statsLock);
+		std::copy(std::begin(m_opStats), std::end(m_opStats), std::begin(ret.op));
+		ret.missNames = m_missNames;
+		return ret;
+	}
+
+	void UIResourceMgr::SetTraceCallback(std::function<void(const UIResourceTraceEvent&)> callback)
+	{
+		std::lock_guard lock(m_statsLock);
+		if (callback)
+			m_traceCallback = std::make_shared<std::function<void(const UIResourceTraceEvent&)>>(std::move(callback));
+		else
+			m_traceCallback = nullptr;
+	}
+
+	//以UTF-8写入JSON字符串
+	static void AppendJsonString(std::string& dst, std::wstring_view str)
+	{
+		dst += '"';
+		for (size_t i = 0; i < str.length(); ++i)
+		{
+			_m_uint ch = (_m_uint)str[i];
+			//UTF-16代理对
+			if (ch >= 0xD800 && ch <= 0xDBFF && i + 1 < str.length()
+				&& (_m_uint)str[i + 1] >= 0xDC00 && (_m_uint)str[i + 1] <= 0xDFFF)
+			{
+				ch = 0x10000 + ((ch - 0xD800) << 10) + ((_m_uint)str[i + 1] - 0xDC00);
+				++i;
+			}
+			if (ch == '"' || ch == '\\')
+			{
+				dst += '\\';
+				dst += (char)ch;
+			}
+			else if (ch < 0x20)
+			{
+				char buffer[8];
+				snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
+				dst += buffer;
+			}
+			else if (ch < 0x80)
+				dst += (char)ch;
+			else if (ch < 0x800)
+			{
+				dst += (char)(0xC0 | (ch >> 6));
+				dst += (char)(0x80 | (ch & 0x3F));
+			}
+			else if (ch < 0x10000)
+			{
+				dst += (char)(0xE0 | (ch >> 12));
+				dst += (char)(0x80 | ((ch >> 6) & 0x3F));
+				dst += (char)(0x80 | (ch & 0x3F));
+			}
+			else
+			{
+				dst += (char)(0xF0 | (ch >> 18));
+				dst += (char)(0x80 | ((ch >> 12) & 0x3F));
+				dst += (char)(0x80 | ((ch >> 6) & 0x3F));
+				dst += (char)(0x80 | (ch & 0x3F));
+			}
+		}
+		dst += '"';
+	}
+
+	bool UIResourceMgr::DumpStats(std::wstring_view path)
+	{
+		const UIResourceStats stats = GetStats();
+		std::string json = "{\n";
+		auto Value = [&json](const char* key, _m_size value, bool last = false)
+		{
+			json += "\"";
+			json += key;
+			json += "\": ";
+			json += std::to_string(value);
+			json += last ? "" : ", ";
+		};
+
+		json += "\"resFileCount\": " + std::to_string(stats.resFileCount) + ",\n";
+		json += "\"nameCount\": " + std::to_string(stats.nameCount) + ",\n";
+		json += "\"style\": { ";
+		Value("count", stats.styleCount);
+		Value("lazy", stats.lazyStyleCount);
+		Value("image", stats.imageStyleCount);
+		Value("geometry", stats.geometryStyleCount, true);
+		json += " },\n";
+
+		static const char* opName[] =
+		{
+			"readResource", "decodeBitmap", "loadStyle", "sharedBitmap", "geometryStyle", "geometryCode"
+		};
+		static_assert(std::size(opName) == (size_t)UIResourceOp::Count);
+		json += "\"op\": {\n";
+		for (size_t i = 0; i < std::size(opName); ++i)
+		{
+			const auto& op = stats.op[i];
+			json += "\t\"";
+			json += opName[i];
+			json += "\": { ";
+			Value("count", op.count);
+			Value("fails", op.fails);
+			Value("timeUs", op.time);
+			Value("maxTimeUs", op.maxTime);
+			Value("bytes", op.bytes, true);
+			json += i + 1 < std::size(opName) ? " },\n" : " }\n";
+		}
+		json += "},\n";
+
+		const auto& cache = stats.bitmapCache;
+		json += "\"bitmapCache\": { ";
+		Value("hits", cache.hits);
+		Value("misses", cache.misses);
+		Value("evictions", cache.evictions);
+		Value("residentBytes", cache.residentBytes);
+		Value("uniqueBytes", cache.uniqueBytes);
+		Value("count", cache.count);
+		Value("budget", cache.budget);
+		Value("dedupHits", cache.dedupHits, true);
+		json += " },\n";
+
+		json += "\"load\": { ";
+		Value("syncCount", stats.load.syncCount);
+		Value("syncTimeUs", stats.load.syncTime);
+		Value("prefetchHits", stats.load.prefetchHits);
+		Value("manifestCount", stats.load.manifestCount, true);
+		json += " },\n";
+
+		json += "\"missNames\": [";
+		for (size_t i = 0; i < stats.missNames.size(); ++i)
+		{
+			if (i != 0) json += ", ";
+			AppendJsonString(json, stats.missNames[i]);
+		}
+		json += "],\n";
+
+		//缓存中的位图 按最近使用顺序
+		json += "\"bitmaps\": [";
+		{
+			std::lock_guard lock(m_sharedBmpLock);
+			bool first = true;
+			for (const auto& name : m_sharedBmpLRU)
+			{
+				const auto& data = m_sharedBmpList[name];
+				json += first ? "\n\t{ \"name\": " : ",\n\t{ \"name\": ";
+				first = false;
+				AppendJsonString(json, name);
+				json += ", ";
+				UISize size;
+				if (const auto bitmap = data.bitmap->GetBitmap())
+					size = bitmap->GetSize();
+				Value("width", (_m_size)size.width);
+				Value("height", (_m_size)size.height);
+				Value("bytes", data.bytes);
+				Value("refCount", (_m_size)data.bitmap->GetRefCount());
+				json += "\"loading\": ";
+				json += data.bitmap->IsLoading() ? "true" : "false";
+				json += " }";
+			}
+		}
+		json += "\n]\n}\n";
+
+		const UIResource res((_m_byte*)json.data(), (_m_size)json.size());
+		try
+		{
+			return FS::MWriteFile(path, res) == res.size;
+		}
+		catch (const MError&)
+		{
+			return false;
+		}
+	}
+
+	void UIResourceMgr::StopPrefetch()
+	{
+		{
+			std::lock_guard lock(m_prefetchLock);
+			m_prefetchQueue.clear();
+		}
+		if (m_prefetchThread.joinable())
+			m_prefetchThread.join();
+	}
+
 	bool UIResourceMgr::AddImageStyleInternal(UIResource memimg, _m_ushort count,
-		UIStyle** dst, bool nineGrid, _m_rect_t<int> gridpath)
+		UIStyle** dst, bool nineGrid, _m_rect_t<int> gridpath, std::wstring_view cacheName)
 	{
-		auto bmp = CreateUniqueUIBitamp(memimg);
+		UIBitmapPtr bmp = nullptr;
+		if (!cacheName.empty())
+		{
+			//来自资源文件的位图使用共享位图缓存 相同内容只创建一次
+			if (const auto bitmap = CreateContentBitmap(memimg, cacheName))
+			{
+				bmp = new UIBitmap();
+				bmp->m_bitmap = bitmap;
+			}
+		}
+		else
+			bmp = CreateUniqueUIBitamp(memimg);
 		if (!bmp)
 			return false;
 
 		UIStyleImage* ret = new UIStyleImage();
-		ret->m_bitmap = bmp;
+		//来自资源文件的位图可以被缓存淘汰 绘制时重新获取
+		if (!cacheName.empty())
+		{
+			ret->m_mgr = this;
+			ret->m_cacheName = cacheName;
+			AddSharedBitmap(ret->m_cacheName, bmp);
+		}
+		else
+			ret->m_bitmap = bmp;
 		ret->m_nineGrid = nineGrid;
 		ret->m_gridPath = gridpath;
 		ret->m_partCount = count;
@@ -326,6 +1652,46 @@ namespace Mui
 	}
 
 	bool UIResourceMgr::AddGeometryStyleInternal(std::wstring_view xml, UIStyle** dst)
+	{
+		const auto begin = std::chrono::steady_clock::now();
+
+		UIStyleGeometry* style = new UIStyleGeometry();
+		if (!ParseGeometryXML(xml, style))
+		{
+			style->Release();
+			TraceOp(UIResourceOp::GeometryStyle, {}, begin, xml.size() * sizeof(wchar_t), false);
+			return false;
+		}
+		style->AddRef();
+		style->InitResource(m_render);
+		if (dst)
+			*dst = style;
+
+		TraceOp(UIResourceOp::GeometryStyle, {}, begin, xml.size() * sizeof(wchar_t), true);
+		return true;
+	}
+
+	bool UIResourceMgr::AddGeometryCodeInternal(UIResource code, UIStyle** dst)
+	{
+		const auto begin = std::chrono::steady_clock::now();
+
+		UIStyleGeometry* style = new UIStyleGeometry();
+		if (!ParseGeometryCode(code, style))
+		{
+			style->Release();
+			TraceOp(UIResourceOp::GeometryCode, {}, begin, code.size, false);
+			return false;
+		}
+		style->AddRef();
+		style->InitResource(m_render);
+		if (dst)
+			*dst = style;
+
+		TraceOp(UIResourceOp::GeometryCode, {}, begin, code.size, true);
+		return true;
+	}
+
+	bool UIResourceMgr::ParseGeometryXML(std::wstring_view xml, UIStyleGeometry* style)
 	{
 		pugi::xml_document doc;
 		std::wstring _xml = xml.data();
@@ -337,7 +1703,6 @@ namespace Mui
 		if (root.empty())
 			return false;
 
-		UIStyleGeometry* style = nullptr;
 		int count = 0;
 
 		//解析指令
@@ -430,41 +1795,154 @@ namespace Mui
 					continue;
 				cmdList.push_back(data);
 			}
-
-			if (!style)
-				style = new UIStyleGeometry();
-
 			style->m_cmdlist.push_back(std::move(cmdList));
 
 			count++;
 		}
-		if(style)
+		style->m_partCount = (_m_ushort)count;
+		return count != 0;
+	}
+
+	bool UIResourceMgr::ParseGeometryCode(UIResource code, UIStyleGeometry* style)
+	{
+		if (!code || code.size < sizeof(GeometryCodeMagic) + 2
+			|| memcmp(code.data, GeometryCodeMagic, sizeof(GeometryCodeMagic)) != 0)
+			return false;
+
+		const _m_byte* ptr = code.data + sizeof(GeometryCodeMagic);
+		const _m_byte* end = code.data + code.size;
+
+		auto Read = [&ptr](int bytes)
 		{
-			style->m_partCount = (_m_ushort)count;
-			style->AddRef();
-			style->InitResource(m_render);
-			if (dst)
-				*dst = style;
-			return true;
+			_m_uint value = 0;
+			for (int i = 0; i < bytes; ++i)
+				value |= (_m_uint)*ptr++ << (i * 8);
+			return value;
+		};
+
+		const _m_ushort partCount = (_m_ushort)Read(2);
+		if (partCount == 0)
+			return false;
+
+		style->m_cmdlist.resize(partCount);
+		for (auto& part : style->m_cmdlist)
+		{
+			if (end - ptr < 2)
+				return false;
+			const size_t cmdCount = Read(2);
+			if ((size_t)(end - ptr) < cmdCount * GeometryCodeCmdSize)
+				return false;
+
+			part.resize(cmdCount);
+			for (auto& cmd : part)
+			{
+				cmd.type = (int)Read(1);
+				for (auto& rctype : cmd.m_rctype)
+					rctype = (_m_byte)Read(1);
+				cmd.m_dst.left = (int)Read(4);
+				cmd.m_dst.top = (int)Read(4);
+				cmd.m_dst.right = (int)Read(4);
+				cmd.m_dst.bottom = (int)Read(4);
+				const auto r = (_m_byte)Read(1);
+				const auto g = (_m_byte)Read(1);
+				const auto b = (_m_byte)Read(1);
+				const auto a = (_m_byte)Read(1);
+				cmd.color = Color::M_RGBA(r, g, b, a);
+				const _m_uint param = Read(4);
+				memcpy(&cmd.param, &param, sizeof(float));
+				cmd.width = (int)Read(4);
+			}
 		}
-		return false;
+		style->m_partCount = partCount;
+		return ptr == end;
+	}
+
+	bool UIResourceMgr::SwapStyle(UIStyle* dst, UIStyle* src)
+	{
+		if (const auto image = dynamic_cast<UIStyleImage*>(dst))
+		{
+			const auto srcImage = dynamic_cast<UIStyleImage*>(src);
+			if (!srcImage) return false;
+			std::swap(image->m_bitmap, srcImage->m_bitmap);
+			std::swap(image->m_mgr, srcImage->m_mgr);
+			std::swap(image->m_cacheName, srcImage->m_cacheName);
+			std::swap(image->m_atlasRect, srcImage->m_atlasRect);
+			//位图名称可能已改变 下次绘制时重新获取
+			image->m_pinned = nullptr;
+			srcImage->m_pinned = nullptr;
+		}
+		else if (const auto geometry = dynamic_cast<UIStyleGeometry*>(dst))
+		{
+			const auto srcGeometry = dynamic_cast<UIStyleGeometry*>(src);
+			if (!srcGeometry) return false;
+			std::swap(geometry->m_cmdlist, srcGeometry->m_cmdlist);
+			std::swap(geometry->m_pen, srcGeometry->m_pen);
+			std::swap(geometry->m_brush, srcGeometry->m_brush);
+		}
+		else
+			return false;
+		std::swap(dst->m_type, src->m_type);
+		std::swap(dst->m_partCount, src->m_partCount);
+		std::swap(dst->m_nineGrid, src->m_nineGrid);
+		std::swap(dst->m_gridPath, src->m_gridPath);
+		return true;
+	}
+
+	bool UIResourceMgr::LoadResFile(DMResources* dmres, std::wstring_view path, bool mapped)
+	{
+		if (mapped && dmres->LoadResourceMapped(path.data()))
+			return true;
+		return dmres->LoadResource(path.data(), false);
+	}
+
+	void UIResourceMgr::FreeResFile(resfile& file)
+	{
+		delete file.file.first;
+		file.file.first = nullptr;
+	}
+
+	void UIResourceMgr::AddNameDir(size_t index)
+	{
+		std::vector<std::wstring> list;
+		m_resList[index].file.first->EnumResourceName(list);
+		m_nameDir.reserve(m_nameDir.size() + list.size());
+		for (auto& name : list)
+			m_nameDir.emplace(std::move(name), index);
 	}
 
-	void UIResourceMgr::FreeResFile(MUIRESFILE& file)
+	UIResourceMgr::resfile* UIResourceMgr::FindResFile(std::wstring_view name)
 	{
-		delete file.first;
-		file.first = nullptr;
+		if (auto iter = m_nameDir.find(name.data()); iter != m_nameDir.end())
+			return &m_resList[iter->second];
+		return nullptr;
 	}
 
 	void UIStyleImage::PaintStyle(Render::MRenderCmd* render, MPCRect dest, _m_byte alpha,
 	                              int state, _m_ushort count, _m_scale scale)
 	{
-		if (!m_bitmap) 
+		UIBitmapPtr image = m_bitmap;
+		if (!image && m_mgr)
+		{
+			if (!m_pinned)
+				m_pinned = m_mgr->CreateSharedUIBitmap(m_cacheName);
+			image = m_pinned;
+			m_pinFrame = m_mgr->m_paintFrame;
+			if (image && !m_pinListed)
+			{
+				m_pinListed = true;
+				m_mgr->m_pinnedStyle.emplace_back(this);
+			}
+		}
+		if (!image)
 			return;
 
-		auto bitmap = m_bitmap->GetBitmap();
+		auto bitmap = image->GetBitmap();
+		if (!bitmap)
+			return;
 
-		UISize styleSize = bitmap->GetSize();
+		//已打包到图集时只使用图集中属于该Style的区域
+		const bool atlas = !m_atlasRect.IsEmpty();
+		UISize styleSize = atlas ? UISize{ m_atlasRect.GetWidth(), m_atlasRect.GetHeight() } : bitmap->GetSize();
 		styleSize.width /= m_partCount;
 
 		if (m_partCount == count)
@@ -472,6 +1950,13 @@ namespace Mui
 			_m_rect rect_ = _m_rect(styleSize.width * state, 0, styleSize.width * (state + 1), styleSize.height);
 			if (state == 0)
 				rect_.left = 0;
+			if (atlas)
+			{
+				rect_.left += m_atlasRect.left;
+				rect_.right += m_atlasRect.left;
+				rect_.top += m_atlasRect.top;
+				rect_.bottom += m_atlasRect.top;
+			}
 			if (!m_nineGrid)
 				render->DrawBitmap(bitmap, alpha, *dest, rect_);
 			else
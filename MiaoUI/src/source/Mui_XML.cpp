@@ -219,7 +219,15 @@ namespace Mui::XML
         if (m_defStyleInited) return;
         m_defStyleInited = true;
 
+#if MUI_MXML_DEFSTYLE_BYTECODE
+#ifdef _DEBUG
+        if (!DefStyle::_g_mui_default_uistyle_checkcode())
+            _M_OutErrorDbg_(L"默认样式字节码与xml不一致 请重新生成Mui_DefUIStyleCode.h", false);
+#endif
+        DefStyle::_g_mui_default_uistyle_loadcode(Mgr());
+#else
         DefStyle::_g_mui_default_uistyle_loadxml(Mgr());
+#endif
         AddDefPropGroup(DefStyle::_g_mui_default_uistyle, true);
     }
 
@@ -20,15 +20,149 @@
 */
 
 #include <Render/Mui_RenderMgr.h>
+#include <Mui_Helper.h>
 
 namespace Mui::Render
 {
 	using namespace RAII;
 
+	namespace
+	{
+		//记录模式的命令类型
+		enum CmdType : _m_ushort
+		{
+			Cmd_BeginDraw,
+			Cmd_SetCanvas,
+			Cmd_ResetCanvas,
+			Cmd_DrawBitmap,
+			Cmd_DrawCanvas,
+			Cmd_DrawNinePalacesImg,
+			Cmd_DrawNinePalacesCanvas,
+			Cmd_DrawRectangle,
+			Cmd_DrawRoundedRect,
+			Cmd_FillRectangle,
+			Cmd_FillRoundedRect,
+			Cmd_DrawLine,
+			Cmd_DrawEllipse,
+			Cmd_FillEllipse,
+			Cmd_PushClipRect,
+			Cmd_PopClipRect,
+			Cmd_PushClipGeometry,
+			Cmd_PopClipGeometry,
+			Cmd_Clear,
+			Cmd_Flush
+		};
+
+		struct CmdObject
+		{
+			MRenderObj* obj;
+		};
+
+		struct CmdImage
+		{
+			MRenderObj* obj;
+			_m_rect dest;
+			_m_rect src;
+			_m_byte alpha;
+			bool highQuality;
+		};
+
+		struct CmdNinePalaces
+		{
+			MRenderObj* obj;
+			_m_rect dest;
+			_m_rect src;
+			_m_rect margin;
+			_m_byte alpha;
+			bool highQuality;
+		};
+
+		//记录时复制的画笔和画刷状态 不持有原对象 之后修改原对象不影响已记录的命令
+		struct CmdPen
+		{
+			_m_color color;
+			_m_uint width;
+			_m_byte opacity;
+		};
+
+		struct CmdBrush
+		{
+			_m_color color;
+			_m_byte opacity;
+		};
+
+		//矩形 圆角矩形和椭圆的边框
+		struct CmdStroke
+		{
+			CmdPen pen;
+			_m_rect dest;
+			float round;
+		};
+
+		//矩形 圆角矩形和椭圆的填充
+		struct CmdFill
+		{
+			CmdBrush brush;
+			_m_rect dest;
+			float round;
+		};
+
+		struct CmdLine
+		{
+			CmdPen pen;
+			UIPoint x;
+			UIPoint y;
+		};
+
+		CmdPen PenState(MPen* pen)
+		{
+			return { pen->GetColor(), pen->GetWidth(), pen->GetOpacity() };
+		}
+
+		CmdBrush BrushState(MBrush* brush)
+		{
+			return { brush->GetColor(), brush->GetOpacity() };
+		}
+
+		struct CmdRect
+		{
+			_m_rect rect;
+		};
+
+		struct CmdColor
+		{
+			_m_color color;
+		};
+	}
+
+	_m_byte* MRenderCmdBuffer::Alloc(_m_ushort type, size_t size)
+	{
+		const size_t total = (sizeof(header) + size + 7) & ~(size_t)7;
+		if (m_size + total > m_data.size())
+			m_data.resize(Helper::M_MAX(Helper::M_MAX(m_data.size() * 2, m_size + total), (size_t)4096));
+
+		_m_byte* ptr = m_data.data() + m_size;
+		const header head = { type, (_m_uint)total };
+		std::memcpy(ptr, &head, sizeof(header));
+		m_size += total;
+		m_count++;
+		return ptr + sizeof(header);
+	}
+
+	void MRenderCmdBuffer::Reset()
+	{
+		m_size = 0;
+		m_count = 0;
+		for (auto& obj : m_refs)
+			obj->Release();
+		m_refs.clear();
+	}
+
 	MRenderCmd::MRenderCmd(MRender* base)
 	{
 		m_stop = false;
 		m_begindraw = false;
+		m_recordThread = std::thread::id();
 		m_base = base;
 		m_base->m_base = this;
 		m_thread = std::thread(&MRenderCmd::ThreadProc, this);
@@ -36,6 +170,11 @@ namespace Mui::Render
 
 	MRenderCmd::~MRenderCmd()
 	{
+		//未提交的命令交给渲染线程 持有的对象需要在渲染线程释放
+		{
+			std::unique_lock lock(m_tasklock);
+			QueueRecordBuffer();
+		}
 		m_stop = true;
 		m_signal.notify_one();
 		m_thread.join();
@@ -259,6 +398,11 @@ namespace Mui::Render
 		else
 		{
 			m_begindraw = true;
+			if (const auto buffer = RecordBuffer())
+			{
+				buffer->Push(Cmd_BeginDraw);
+				return;
+			}
 			Task([=]
 			{
 				m_base->BeginDraw();
@@ -268,6 +412,11 @@ namespace Mui::Render
 
 	void MRenderCmd::SetCanvas(MCanvasPtr canvas)
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_SetCanvas, CmdObject{ buffer->Hold(canvas) });
+			return;
+		}
 		Task([&]
 		{
 			m_base->SetCanvas(canvas.get());
@@ -276,6 +425,11 @@ namespace Mui::Render
 
 	void MRenderCmd::ResetCanvas()
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_ResetCanvas);
+			return;
+		}
 		Task([this]
 		{
 			m_base->ResetCanvas();
@@ -284,6 +438,11 @@ namespace Mui::Render
 
 	void MRenderCmd::DrawBitmap(MBitmapPtr img, _m_byte alpha, _m_rect dest, _m_rect src, bool highQuality)
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_DrawBitmap, CmdImage{ buffer->Hold(img), dest, src, alpha, highQuality });
+			return;
+		}
 		Task([&]
 		{
 			m_base->DrawBitmap(img.get(), alpha, dest, src, highQuality);
@@ -292,6 +451,11 @@ namespace Mui::Render
 
 	void MRenderCmd::DrawBitmap(MCanvasPtr canvas, _m_byte alpha, _m_rect dest, _m_rect src, bool highQuality)
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_DrawCanvas, CmdImage{ buffer->Hold(canvas), dest, src, alpha, highQuality });
+			return;
+		}
 		Task([&]
 		{
 			m_base->DrawBitmap(canvas.get(), alpha, dest, src, highQuality);
@@ -316,6 +480,11 @@ namespace Mui::Render
 
 	void MRenderCmd::DrawNinePalacesImg(MBitmapPtr img, _m_byte alpha, _m_rect dest, _m_rect src, _m_rect margin, bool highQuality)
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_DrawNinePalacesImg, CmdNinePalaces{ buffer->Hold(img), dest, src, margin, alpha, highQuality });
+			return;
+		}
 		Task([&]
 		{
 			m_base->DrawNinePalacesImg(img.get(), alpha, dest, src, margin, highQuality);
@@ -324,6 +493,11 @@ namespace Mui::Render
 
 	void MRenderCmd::DrawNinePalacesImg(MCanvasPtr canvas, _m_byte alpha, _m_rect dest, _m_rect src, _m_rect margin, bool highQuality)
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_DrawNinePalacesCanvas, CmdNinePalaces{ buffer->Hold(canvas), dest, src, margin, alpha, highQuality });
+			return;
+		}
 		Task([&]
 		{
 			m_base->DrawNinePalacesImg(canvas.get(), alpha, dest, src, margin, highQuality);
@@ -332,6 +506,11 @@ namespace Mui::Render
 
 	void MRenderCmd::DrawRectangle(_m_rect dest, MPenPtr pen)
 	{
+		if (const auto buffer = RecordBuffer(); buffer && pen)
+		{
+			buffer->Push(Cmd_DrawRectangle, CmdStroke{ PenState(pen.get()), dest, 0.f });
+			return;
+		}
 		Task([&]
 		{
 			m_base->DrawRectangle(dest, pen.get());
@@ -340,6 +519,11 @@ namespace Mui::Render
 
 	void MRenderCmd::DrawRoundedRect(_m_rect dest, float round, MPenPtr pen)
 	{
+		if (const auto buffer = RecordBuffer(); buffer && pen)
+		{
+			buffer->Push(Cmd_DrawRoundedRect, CmdStroke{ PenState(pen.get()), dest, round });
+			return;
+		}
 		Task([&]
 		{
 			m_base->DrawRoundedRect(dest, round, pen.get());
@@ -348,6 +532,11 @@ namespace Mui::Render
 
 	void MRenderCmd::FillRectangle(_m_rect dest, MBrushPtr brush)
 	{
+		if (const auto buffer = RecordBuffer(); buffer && brush)
+		{
+			buffer->Push(Cmd_FillRectangle, CmdFill{ BrushState(brush.get()), dest, 0.f });
+			return;
+		}
 		Task([&]
 		{
 			m_base->FillRectangle(dest, brush.get());
@@ -364,6 +553,11 @@ namespace Mui::Render
 
 	void MRenderCmd::FillRoundedRect(_m_rect dest, float round, MBrushPtr brush)
 	{
+		if (const auto buffer = RecordBuffer(); buffer && brush)
+		{
+			buffer->Push(Cmd_FillRoundedRect, CmdFill{ BrushState(brush.get()), dest, round });
+			return;
+		}
 		Task([&]
 		{
 			m_base->FillRoundedRect(dest, round, brush.get());
@@ -396,6 +590,11 @@ namespace Mui::Render
 
 	void MRenderCmd::DrawLine(UIPoint x, UIPoint y, MPenPtr pen)
 	{
+		if (const auto buffer = RecordBuffer(); buffer && pen)
+		{
+			buffer->Push(Cmd_DrawLine, CmdLine{ PenState(pen.get()), x, y });
+			return;
+		}
 		Task([&]
 		{
 			m_base->DrawLine(x, y, pen.get());
@@ -404,6 +603,11 @@ namespace Mui::Render
 
 	void MRenderCmd::DrawEllipse(_m_rect dest, MPenPtr pen)
 	{
+		if (const auto buffer = RecordBuffer(); buffer && pen)
+		{
+			buffer->Push(Cmd_DrawEllipse, CmdStroke{ PenState(pen.get()), dest, 0.f });
+			return;
+		}
 		Task([&]
 		{
 			m_base->DrawEllipse(dest, pen.get());
@@ -412,6 +616,11 @@ namespace Mui::Render
 
 	void MRenderCmd::FillEllipse(_m_rect dest, MBrushPtr brush)
 	{
+		if (const auto buffer = RecordBuffer(); buffer && brush)
+		{
+			buffer->Push(Cmd_FillEllipse, CmdFill{ BrushState(brush.get()), dest, 0.f });
+			return;
+		}
 		Task([&]
 		{
 			m_base->FillEllipse(dest, brush.get());
@@ -420,6 +629,11 @@ namespace Mui::Render
 
 	void MRenderCmd::PushClipRect(_m_rect rect)
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_PushClipRect, CmdRect{ rect });
+			return;
+		}
 		Task([&]
 		{
 			m_base->PushClipRect(rect);
@@ -428,6 +642,11 @@ namespace Mui::Render
 
 	void MRenderCmd::PopClipRect()
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_PopClipRect);
+			return;
+		}
 		Task([this]
 		{
 			m_base->PopClipRect();
@@ -436,6 +655,11 @@ namespace Mui::Render
 
 	void MRenderCmd::PushClipGeometry(MGeometryPtr geometry)
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_PushClipGeometry, CmdObject{ buffer->Hold(geometry) });
+			return;
+		}
 		Task([&]
 		{
 			m_base->PushClipGeometry(geometry.get());
@@ -444,6 +668,11 @@ namespace Mui::Render
 
 	void MRenderCmd::PopClipGeometry()
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_PopClipGeometry);
+			return;
+		}
 		Task([&]
 		{
 			m_base->PopClipGeometry();
@@ -452,6 +681,11 @@ namespace Mui::Render
 
 	void MRenderCmd::Clear(_m_color color)
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_Clear, CmdColor{ color });
+			return;
+		}
 		Task([&]
 		{
 			m_base->Clear(color);
@@ -501,6 +735,11 @@ namespace Mui::Render
 
 	void MRenderCmd::Flush()
 	{
+		if (const auto buffer = RecordBuffer())
+		{
+			buffer->Push(Cmd_Flush);
+			return;
+		}
 		Task([&]
 		{
 			m_base->Flush();
@@ -569,27 +808,63 @@ namespace Mui::Render
 
 	void MRenderCmd::ThreadProc()
 	{
+		//与m_taskList交换使用 保留两者的容量
+		std::vector<taskParam> batch;
 		while (!m_stop)
 		{
-			std::unique_lock lock(m_tasklock);
-			while (m_taskList.empty() && !m_stop)
-				m_signal.wait(lock);
+			{
+				std::unique_lock lock(m_tasklock);
+				while (m_taskList.empty() && m_postQueue.isEmpty() && !m_stop)
+				{
+					//设置标志后再次检查 避免与Post之间丢失唤醒
+					m_sleeping = true;
+					if (!m_postQueue.isEmpty())
+						break;
+					m_signal.wait(lock);
+				}
+				m_sleeping = false;
+				batch.swap(m_taskList);
+				m_stats.batchCount++;
+			}
+
+			//先执行在这些任务之前投递的异步任务和提交的命令缓冲区
+			RunPostTasks();
 
-			for (auto& task_item : m_taskList)
+			for (auto& task_item : batch)
 			{
 				//传递异常到目标等待线程
+				std::exception_ptr error = nullptr;
 				try
 				{
 					task_item.task();
-					task_item.notification.set_value();
 				}
 				catch(...)
 				{
-					task_item.notification.set_exception(std::current_exception());
+					error = std::current_exception();
 				}
+				//在锁内通知 等待方返回后可能立即复用或销毁waiter
+				taskWaiter* waiter = task_item.waiter;
+				std::unique_lock lock(waiter->lock);
+				waiter->error = error;
+				waiter->done = true;
+				waiter->signal.notify_one();
 			}
-			m_taskList.clear();
+			batch.clear();
 		}
+
+		//退出时释放未回放的命令缓冲区持有的对象
+		postTask item;
+		while (m_postQueue.pop(item))
+		{
+			if (item.buffer)
+				item.buffer->Reset();
+			item = {};
+		}
+		std::unique_lock lock(m_tasklock);
+		if (m_recordBuf)
+			m_recordBuf->Reset();
+		m_replayPen = nullptr;
+		m_replayBrush = nullptr;
 	}
 
 	void MRenderCmd::Task(std::function<void()>&& task)
@@ -599,19 +874,376 @@ namespace Mui::Render
 			task();
 			return;
 		}
+		const bool recording = IsRecording();
 		std::exception_ptr ex = nullptr;
-		std::promise<void> send_notification;
-		auto wait_notification = send_notification.get_future();
+		static thread_local taskWaiter waiter;
 		{
-			std::unique_lock lock(m_tasklock);
-			m_taskList.emplace_back(task, send_notification);
+			auto lock = LockTaskList();
+			//先提交已记录的命令 保证执行顺序
+			if (recording)
+				QueueRecordBuffer();
+			m_taskList.emplace_back(std::move(task), &waiter);
 		}
 		m_signal.notify_one();
-		wait_notification.get();
+		{
+			std::unique_lock lock(waiter.lock);
+			while (!waiter.done)
+				waiter.signal.wait(lock);
+			waiter.done = false;
+			std::swap(ex, waiter.error);
+		}
+		//传递渲染线程的异常
+		if (ex)
+			std::rethrow_exception(ex);
+
+		if (recording)
+		{
+			{
+				std::unique_lock lock(m_tasklock);
+				ex = m_recordError;
+				m_recordError = nullptr;
+			}
+			if (ex)
+				std::rethrow_exception(ex);
+		}
+	}
+
+	std::unique_lock<std::mutex> MRenderCmd::LockTaskList()
+	{
+		//未发生竞争时不计时
+		std::unique_lock lock(m_tasklock, std::try_to_lock);
+		_m_size wait = 0;
+		if (!lock.owns_lock())
+		{
+			const auto begin = std::chrono::steady_clock::now();
+			lock.lock();
+			wait = (_m_size)std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - begin).count();
+			m_stats.contendedCount++;
+		}
+		m_stats.enqueueCount++;
+		m_stats.lockWaitTime += wait;
+		m_stats.lockWaitMax = Helper::M_MAX(m_stats.lockWaitMax, wait);
+		return lock;
+	}
+
+	MRenderCmdStats MRenderCmd::GetStats()
+	{
+		std::unique_lock lock(m_tasklock);
+		MRenderCmdStats ret = m_stats;
+		ret.postCount = m_postCount;
+		return ret;
+	}
+
+	void MRenderCmd::ResetStats()
+	{
+		std::unique_lock lock(m_tasklock);
+		m_stats = {};
+		m_postCount = 0;
 	}
 
 	bool MRenderCmd::IsTaskThread()
 	{
 		return m_thread.get_id() == std::this_thread::get_id();
 	}
+
+	void MRenderCmd::Post(std::function<void()>&& task, std::function<void()>&& completion)
+	{
+		if (IsTaskThread())
+		{
+			task();
+			if (completion)
+				completion();
+			return;
+		}
+		m_postQueue.push({ std::move(task), std::move(completion) });
+		m_postCount++;
+		//渲染线程未休眠时会继续取出任务 连续投递只需唤醒一次
+		if (m_sleeping.exchange(false))
+		{
+			auto lock = LockTaskList();
+			m_stats.wakeCount++;
+			m_signal.notify_one();
+		}
+	}
+
+	void MRenderCmd::WaitPost()
+	{
+		if (IsTaskThread())
+			RunPostTasks();
+		else
+			Task([] {});
+
+		std::exception_ptr ex = nullptr;
+		{
+			std::unique_lock lock(m_tasklock);
+			std::swap(ex, m_postError);
+		}
+		if (ex)
+			std::rethrow_exception(ex);
+	}
+
+	void MRenderCmd::RunPostTasks()
+	{
+		postTask item;
+		while (m_postQueue.pop(item))
+		{
+			if (item.buffer)
+			{
+				//没有等待线程 异常留到记录线程下次同步调用时抛出
+				std::exception_ptr error = nullptr;
+				try
+				{
+					ReplayBuffer(item.buffer.get());
+				}
+				catch (...)
+				{
+					error = std::current_exception();
+				}
+				item.buffer->Reset();
+
+				std::unique_lock lock(m_tasklock);
+				if (error && !m_recordError)
+					m_recordError = error;
+				m_freeBuffer.push_back(std::move(item.buffer));
+				continue;
+			}
+			try
+			{
+				item.task();
+				if (item.completion)
+					item.completion();
+			}
+			catch (...)
+			{
+#ifdef _DEBUG
+				_M_OutErrorDbg_(L"异步任务发生异常", false);
+#endif
+				std::unique_lock lock(m_tasklock);
+				if (!m_postError)
+					m_postError = std::current_exception();
+			}
+			item = {};
+		}
+	}
+
+	bool MRenderCmd::BeginRecord()
+	{
+		//渲染线程的调用本就直接执行
+		if (IsTaskThread())
+			return false;
+		const auto self = std::this_thread::get_id();
+		std::thread::id current;
+		if (m_recordThread.compare_exchange_strong(current, self) || current == self)
+			return true;
+		//记录缓冲区只有一个 不能被其他线程接管
+		_M_OutErrorDbg_(L"其他线程正在记录", false);
+		return false;
+	}
+
+	void MRenderCmd::EndRecord()
+	{
+		if (!IsRecording())
+			return;
+		SubmitCommands();
+		m_recordThread = std::thread::id();
+	}
+
+	void MRenderCmd::SubmitCommands()
+	{
+		if (!IsRecording())
+			return;
+		{
+			auto lock = LockTaskList();
+			if (!QueueRecordBuffer())
+				return;
+		}
+		m_signal.notify_one();
+	}
+
+	bool MRenderCmd::IsRecording()
+	{
+		return m_recordThread.load() == std::this_thread::get_id();
+	}
+
+	MRenderCmdBuffer* MRenderCmd::RecordBuffer()
+	{
+		if (!IsRecording())
+			return nullptr;
+		if (!m_recordBuf)
+			m_recordBuf = std::make_unique<MRenderCmdBuffer>();
+		return m_recordBuf.get();
+	}
+
+	bool MRenderCmd::QueueRecordBuffer()
+	{
+		if (!m_recordBuf || m_recordBuf->Empty())
+			return false;
+		//与异步任务使用同一队列 保持与该线程之前和之后投递的任务的顺序
+		m_postQueue.push({ nullptr, nullptr, std::move(m_recordBuf) });
+		if (!m_freeBuffer.empty())
+		{
+			m_recordBuf = std::move(m_freeBuffer.back());
+			m_freeBuffer.pop_back();
+		}
+		return true;
+	}
+
+	void MRenderCmd::ReplayBuffer(MRenderCmdBuffer* buffer)
+	{
+		const _m_byte* ptr = buffer->m_data.data();
+		const _m_byte* end = ptr + buffer->m_size;
+		while (ptr < end)
+		{
+			MRenderCmdBuffer::header head;
+			std::memcpy(&head, ptr, sizeof(head));
+			const _m_byte* param = ptr + sizeof(head);
+			ptr += head.size;
+
+			auto Param = [param](auto& cmd) { std::memcpy(&cmd, param, sizeof(cmd)); };
+			//设置记录的状态到回放用的画笔和画刷
+			auto Pen = [this](const CmdPen& state) -> MPen*
+			{
+				if (!m_replayPen)
+				{
+					m_replayPen = m_base->CreatePen(state.width, state.color);
+					if (!m_replayPen) return nullptr;
+					m_replayPen->m_base = this;
+				}
+				m_replayPen->SetWidth(state.width);
+				m_replayPen->SetColor(state.color);
+				m_replayPen->SetOpacity(state.opacity);
+				return m_replayPen.get();
+			};
+			auto Brush = [this](const CmdBrush& state) -> MBrush*
+			{
+				if (!m_replayBrush)
+				{
+					m_replayBrush = m_base->CreateBrush(state.color);
+					if (!m_replayBrush) return nullptr;
+					m_replayBrush->m_base = this;
+				}
+				m_replayBrush->SetColor(state.color);
+				m_replayBrush->SetOpacity(state.opacity);
+				return m_replayBrush.get();
+			};
+			switch (head.type)
+			{
+			case Cmd_BeginDraw:
+				m_base->BeginDraw();
+				break;
+			case Cmd_SetCanvas:
+			{
+				CmdObject cmd; Param(cmd);
+				m_base->SetCanvas(static_cast<MCanvas*>(cmd.obj));
+				break;
+			}
+			case Cmd_ResetCanvas:
+				m_base->ResetCanvas();
+				break;
+			case Cmd_DrawBitmap:
+			{
+				CmdImage cmd; Param(cmd);
+				m_base->DrawBitmap(static_cast<MBitmap*>(cmd.obj), cmd.alpha, cmd.dest, cmd.src, cmd.highQuality);
+				break;
+			}
+			case Cmd_DrawCanvas:
+			{
+				CmdImage cmd; Param(cmd);
+				m_base->DrawBitmap(static_cast<MCanvas*>(cmd.obj), cmd.alpha, cmd.dest, cmd.src, cmd.highQuality);
+				break;
+			}
+			case Cmd_DrawNinePalacesImg:
+			{
+				CmdNinePalaces cmd; Param(cmd);
+				m_base->DrawNinePalacesImg(static_cast<MBitmap*>(cmd.obj), cmd.alpha, cmd.dest, cmd.src, cmd.margin, cmd.highQuality);
+				break;
+			}
+			case Cmd_DrawNinePalacesCanvas:
+			{
+				CmdNinePalaces cmd; Param(cmd);
+				m_base->DrawNinePalacesImg(static_cast<MCanvas*>(cmd.obj), cmd.alpha, cmd.dest, cmd.src, cmd.margin, cmd.highQuality);
+				break;
+			}
+			case Cmd_DrawRectangle:
+			{
+				CmdStroke cmd; Param(cmd);
+				if (const auto pen = Pen(cmd.pen))
+					m_base->DrawRectangle(cmd.dest, pen);
+				break;
+			}
+			case Cmd_DrawRoundedRect:
+			{
+				CmdStroke cmd; Param(cmd);
+				if (const auto pen = Pen(cmd.pen))
+					m_base->DrawRoundedRect(cmd.dest, cmd.round, pen);
+				break;
+			}
+			case Cmd_FillRectangle:
+			{
+				CmdFill cmd; Param(cmd);
+				if (const auto brush = Brush(cmd.brush))
+					m_base->FillRectangle(cmd.dest, brush);
+				break;
+			}
+			case Cmd_FillRoundedRect:
+			{
+				CmdFill cmd; Param(cmd);
+				if (const auto brush = Brush(cmd.brush))
+					m_base->FillRoundedRect(cmd.dest, cmd.round, brush);
+				break;
+			}
+			case Cmd_DrawLine:
+			{
+				CmdLine cmd; Param(cmd);
+				if (const auto pen = Pen(cmd.pen))
+					m_base->DrawLine(cmd.x, cmd.y, pen);
+				break;
+			}
+			case Cmd_DrawEllipse:
+			{
+				CmdStroke cmd; Param(cmd);
+				if (const auto pen = Pen(cmd.pen))
+					m_base->DrawEllipse(cmd.dest, pen);
+				break;
+			}
+			case Cmd_FillEllipse:
+			{
+				CmdFill cmd; Param(cmd);
+				if (const auto brush = Brush(cmd.brush))
+					m_base->FillEllipse(cmd.dest, brush);
+				break;
+			}
+			case Cmd_PushClipRect:
+			{
+				CmdRect cmd; Param(cmd);
+				m_base->PushClipRect(cmd.rect);
+				break;
+			}
+			case Cmd_PopClipRect:
+				m_base->PopClipRect();
+				break;
+			case Cmd_PushClipGeometry:
+			{
+				CmdObject cmd; Param(cmd);
+				m_base->PushClipGeometry(static_cast<MGeometry*>(cmd.obj));
+				break;
+			}
+			case Cmd_PopClipGeometry:
+				m_base->PopClipGeometry();
+				break;
+			case Cmd_Clear:
+			{
+				CmdColor cmd; Param(cmd);
+				m_base->Clear(cmd.color);
+				break;
+			}
+			case Cmd_Flush:
+				m_base->Flush();
+				break;
+			default:
+				break;
+			}
+		}
+	}
 }
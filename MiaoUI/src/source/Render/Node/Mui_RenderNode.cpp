@@ -207,29 +207,22 @@ namespace Mui::Render
 		return m_rootNode;
 	}
 
-	void MNodeRoot::RenderTree(void* data)
+	void MNodeRoot::RenderTree(void* data, const _m_rect* cullRect, size_t cullCount)
 	{
 		std::lock_guard lock(mx);
-		for (auto& node : m_drawList)
+		if (m_drawListChanged)
 		{
-			if (node.node->Visible())
-			{
-				node.node->OnRender(m_render, data);
-				if (node.node->m_nodeList.empty())
-				{
-					node.node->OnRenderChildEnd(m_render, data);
-				}
-			}
-			//子节点渲染结束
-			auto parent = node.node->m_parent;
-			if (node.node != parent->m_nodeList.back())
-				continue;
+			CalcSubtreeEnd();
+			m_drawListChanged = false;
+		}
 
-			//确认是最后一个子节点
-			if (!node.node->m_nodeList.empty())
-				continue;
+		//Node所在子树结束 如果是最后一个子节点 向上遍历父级
+		auto childEnd = [this, data](MRenderNode* node)
+		{
+			auto parent = node->m_parent;
+			if (node != parent->m_nodeList.back())
+				return;
 
-			//向上遍历父级
 			while (parent)
 			{
 				if (parent->Visible())
@@ -239,7 +232,67 @@ namespace Mui::Render
 					break;
 				parent = parent->m_parent;
 			}
+		};
+
+		//隐藏的Node其子Node也不可见
+		auto isVisible = [cullRect, cullCount](MRenderNode* node)
+		{
+			if (!node->Visible())
+				return false;
+			_m_rect rect;
+			if (!cullRect || !node->GetRenderRect(rect))
+				return true;
+			for (size_t i = 0; i < cullCount; ++i)
+			{
+				const _m_rect& cull = cullRect[i];
+				if (rect.left < cull.right && rect.right > cull.left
+					&& rect.top < cull.bottom && rect.bottom > cull.top)
+					return true;
+			}
+			return false;
+		};
+
+		m_visitedCount = 0;
+		m_drawnCount = 0;
+		for (size_t i = 0; i < m_drawList.size();)
+		{
+			MRenderNode* node = m_drawList[i].node;
+			m_visitedCount++;
+			if (!isVisible(node))
+			{
+				//跳过整个子树 子树最后一个Node本应触发的父级结束通知由当前Node处理
+				i = m_drawList[i].end;
+				childEnd(node);
+				continue;
+			}
+			node->OnRender(m_render, data);
+			m_drawnCount++;
+			//子节点渲染结束
+			if (node->m_nodeList.empty())
+			{
+				node->OnRenderChildEnd(m_render, data);
+				childEnd(node);
+			}
+			++i;
+		}
+	}
+
+	void MNodeRoot::CalcSubtreeEnd()
+	{
+		//m_drawList按先序排列 子树在其中是连续的
+		std::vector<size_t> stack;
+		for (size_t i = 0; i < m_drawList.size(); ++i)
+		{
+			const MRenderNode* parent = m_drawList[i].node->m_parent;
+			while (!stack.empty() && m_drawList[stack.back()].node != parent)
+			{
+				m_drawList[stack.back()].end = i;
+				stack.pop_back();
+			}
+			stack.push_back(i);
 		}
+		for (const auto index : stack)
+			m_drawList[index].end = m_drawList.size();
 	}
 
 	void MNodeRoot::BindNodeRenderFunc(MRenderNode* last, MRenderNode* node)
@@ -279,6 +332,7 @@ namespace Mui::Render
 		insertList.push_back(getDrawNode(node));
 		pushList(node);
 		m_drawList.insert(insertPos, insertList.begin(), insertList.end());
+		m_drawListChanged = true;
 	}
 
 	void MNodeRoot::UnbindNodeRenderFunc(MRenderNode* node)
@@ -298,6 +352,7 @@ namespace Mui::Render
 			return _m_size(0);
 		};
 
+		m_drawListChanged = true;
 		//从当前Node位置开始往后搜索子Node
 		_m_size beginIndex = unbindfun(node, 0);
 		std::function<void(MRenderNode*, _m_size)> findChild = [&unbindfun, &findChild, this](MRenderNode* _node, _m_size begin)
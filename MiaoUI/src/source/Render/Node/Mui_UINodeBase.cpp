@@ -300,7 +300,7 @@ namespace Mui::Render
 				frame.right = frame.left + _size.width;
 				frame.bottom = frame.top + _size.height;
 
-				m_data.Align.Intersect(&m_data.ClipFrame, &box, &m_data.Frame);
+				m_data.Align.Intersect(&m_data.ClipFrame, &clip, &m_data.Frame);
 
 				m_data.Align.Layout(this, 0, false);
 
@@ -319,7 +319,7 @@ namespace Mui::Render
 				frame.right = frame.left + _size.width;
 				frame.bottom = frame.top + _size.height;
 
-				m_data.Align.Intersect(&m_data.ClipFrame, &box, &m_data.Frame);
+				m_data.Align.Intersect(&m_data.ClipFrame, &clip, &m_data.Frame);
 
 				m_data.Align.Layout(this, 0, false);
 
@@ -574,6 +574,13 @@ namespace Mui::Render
 		render->PopClipRect();
 	}
 
+	bool UINodeBase::GetRenderRect(_m_rect& rect)
+	{
+		//绘制都在ClipFrame内进行
+		rect = m_data.ClipFrame.ToRectT<int>();
+		return true;
+	}
+
 	void UINodeBase::OnRenderChildEnd(MRenderCmd* render, void* data)
 	{
 		if (!m_data.ParentWnd->m_dbgFrame && !m_brush.FramePen)
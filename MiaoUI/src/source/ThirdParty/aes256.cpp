@@ -224,16 +224,26 @@ static void Cipher(state_t* state, const uint8_t* RoundKey)
     AddRoundKey(Nr, state, RoundKey);
 }
 
+void AES256_KeyExpansion(_m_byte* roundKey, const _m_byte* key)
+{
+    KeyExpansion(roundKey, key);
+}
+
 void AES256_CFB(UIResource src, _m_byte* out, _m_byte* key, _m_byte* iv, bool encrypt)
 {
-    uint8_t RoundKey[240] = { 0 };
+    uint8_t RoundKey[AES256_ROUNDKEY_SIZE] = { 0 };
+    KeyExpansion(RoundKey, key);
+    AES256_CFB_Expanded(src, out, RoundKey, iv, encrypt);
+}
+
+void AES256_CFB_Expanded(UIResource src, _m_byte* out, const _m_byte* roundKey, const _m_byte* iv, bool encrypt)
+{
     uint8_t buffer[AES_BLOCKLEN] = { 0 };
 
     int blocksize = AES_BLOCKLEN;
     int lastblock = src.size / AES_BLOCKLEN;
     if (src.size % AES_BLOCKLEN == 0) lastblock--;
 
-    KeyExpansion(RoundKey, key);
     memcpy(buffer, iv, AES_BLOCKLEN);
 
     if (src.data != out)
@@ -243,7 +253,7 @@ void AES256_CFB(UIResource src, _m_byte* out, _m_byte* key, _m_byte* iv, bool en
     for (i = 0; i <= lastblock; ++i)
     {
         // encrypt iv value
-        Cipher((state_t*)buffer, RoundKey);
+        Cipher((state_t*)buffer, roundKey);
 
         // last block could be smaller because of no padding
         if (i == lastblock)
@@ -4,5 +4,14 @@
 
 using namespace Mui;
 
+//aes256 扩展密钥长度
+#define AES256_ROUNDKEY_SIZE 240
+
 //aes256 cfb模式的软件实现
-void AES256_CFB(UIResource src, _m_byte* out, _m_byte* key, _m_byte* iv, bool encrypt);
\ No newline at end of file
+void AES256_CFB(UIResource src, _m_byte* out, _m_byte* key, _m_byte* iv, bool encrypt);
+
+//aes256 密钥扩展 roundKey长度为AES256_ROUNDKEY_SIZE
+void AES256_KeyExpansion(_m_byte* roundKey, const _m_byte* key);
+
+//aes256 cfb模式 使用已扩展的密钥
+void AES256_CFB_Expanded(UIResource src, _m_byte* out, const _m_byte* roundKey, const _m_byte* iv, bool encrypt);
\ No newline at end of file
@@ -0,0 +1,180 @@
+﻿#include "lz4block.h"
+
+//最小匹配长度
+#define LZ4_MINMATCH 4
+//末尾必须保留为字面量的字节数
+#define LZ4_LASTLITERALS 5
+//最后一个匹配必须在距离末尾该字节数之前开始
+#define LZ4_MFLIMIT 12
+//哈希表尺寸
+#define LZ4_HASHLOG 12
+//最大匹配距离
+#define LZ4_MAXDISTANCE 65535
+
+static _m_uint LZ4_Read32(const _m_byte* p)
+{
+	_m_uint value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static _m_uint LZ4_Hash(_m_uint sequence)
+{
+	return (sequence * 2654435761u) >> (32 - LZ4_HASHLOG);
+}
+
+//写入超过15的长度 每个字节最多255
+static _m_byte* LZ4_WriteLength(_m_byte* op, _m_size len)
+{
+	while (len >= 255)
+	{
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (_m_byte)len;
+	return op;
+}
+
+//读取超过15的长度 越界返回false
+static bool LZ4_ReadLength(const _m_byte*& ip, const _m_byte* iend, _m_size& len)
+{
+	_m_byte value = 0;
+	do
+	{
+		if (ip >= iend)
+			return false;
+		value = *ip++;
+		len += value;
+	} while (value == 255);
+	return true;
+}
+
+//写入一个序列 match为空时为最后的字面量序列
+static _m_byte* LZ4_WriteSequence(_m_byte* op, const _m_byte* anchor, _m_size litLen, _m_uint offset, _m_size matchLen, bool match)
+{
+	_m_byte* token = op++;
+	*token = (_m_byte)((litLen >= 15 ? 15 : litLen) << 4);
+	if (litLen >= 15)
+		op = LZ4_WriteLength(op, litLen - 15);
+	if (litLen)
+		memcpy(op, anchor, litLen);
+	op += litLen;
+	if (!match)
+		return op;
+
+	*op++ = (_m_byte)offset;
+	*op++ = (_m_byte)(offset >> 8);
+	matchLen -= LZ4_MINMATCH;
+	*token |= (_m_byte)(matchLen >= 15 ? 15 : matchLen);
+	if (matchLen >= 15)
+		op = LZ4_WriteLength(op, matchLen - 15);
+	return op;
+}
+
+_m_size LZ4Block_CompressBound(_m_size size)
+{
+	return size + size / 255 + 16;
+}
+
+_m_size LZ4Block_Compress(const _m_byte* src, _m_size size, _m_byte* dst, _m_size capacity)
+{
+	if (capacity < LZ4Block_CompressBound(size))
+		return 0;
+
+	_m_byte* op = dst;
+	const _m_byte* ip = src;
+	const _m_byte* anchor = src;
+	const _m_byte* const end = src + size;
+
+	//数据太短时全部作为字面量
+	if (size > LZ4_MFLIMIT)
+	{
+		//记录每个4字节序列最后出现的位置 候选位置使用前会比较内容
+		std::vector<_m_uint> table((size_t)1 << LZ4_HASHLOG, 0);
+		const _m_byte* const matchLimit = end - LZ4_LASTLITERALS;
+		const _m_byte* const startLimit = end - LZ4_MFLIMIT;
+		while (ip <= startLimit)
+		{
+			const _m_uint sequence = LZ4_Read32(ip);
+			const _m_uint hash = LZ4_Hash(sequence);
+			const _m_byte* ref = src + table[hash];
+			table[hash] = (_m_uint)(ip - src);
+			if (ref >= ip || ip - ref > LZ4_MAXDISTANCE || LZ4_Read32(ref) != sequence)
+			{
+				ip++;
+				continue;
+			}
+			//向前和向后扩展匹配
+			while (ip > anchor && ref > src && ip[-1] == ref[-1])
+			{
+				ip--;
+				ref--;
+			}
+			const _m_byte* matchEnd = ip + LZ4_MINMATCH;
+			const _m_byte* refEnd = ref + LZ4_MINMATCH;
+			while (matchEnd < matchLimit && *matchEnd == *refEnd)
+			{
+				matchEnd++;
+				refEnd++;
+			}
+
+			op = LZ4_WriteSequence(op, anchor, (_m_size)(ip - anchor), (_m_uint)(ip - ref), (_m_size)(matchEnd - ip), true);
+			ip = matchEnd;
+			anchor = ip;
+		}
+	}
+	op = LZ4_WriteSequence(op, anchor, (_m_size)(end - anchor), 0, 0, false);
+	return (_m_size)(op - dst);
+}
+
+_m_size LZ4Block_Decompress(const _m_byte* src, _m_size size, _m_byte* dst, _m_size capacity)
+{
+	const _m_byte* ip = src;
+	const _m_byte* const iend = src + size;
+	_m_byte* op = dst;
+	_m_byte* const oend = dst + capacity;
+
+	while (ip < iend)
+	{
+		const _m_byte token = *ip++;
+		//字面量
+		_m_size litLen = token >> 4;
+		if (litLen == 15 && !LZ4_ReadLength(ip, iend, litLen))
+			return 0;
+		if (litLen > (_m_size)(iend - ip) || litLen > (_m_size)(oend - op))
+			return 0;
+		memcpy(op, ip, litLen);
+		op += litLen;
+		ip += litLen;
+		//最后一个序列只有字面量
+		if (ip == iend)
+			break;
+
+		//匹配
+		if (iend - ip < 2)
+			return 0;
+		const _m_size offset = (_m_size)ip[0] | ((_m_size)ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (_m_size)(op - dst))
+			return 0;
+		_m_size matchLen = token & 15;
+		if (matchLen == 15 && !LZ4_ReadLength(ip, iend, matchLen))
+			return 0;
+		matchLen += LZ4_MINMATCH;
+		if (matchLen > (_m_size)(oend - op))
+			return 0;
+		const _m_byte* ref = op - offset;
+		//匹配可能与输出重叠 此时需要逐字节复制
+		if (offset >= matchLen)
+		{
+			memcpy(op, ref, matchLen);
+			op += matchLen;
+		}
+		else
+		{
+			for (_m_size i = 0; i < matchLen; i++)
+				*op++ = *ref++;
+		}
+	}
+	return (_m_size)(op - dst);
+}
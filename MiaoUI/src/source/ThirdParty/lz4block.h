@@ -0,0 +1,25 @@
+﻿#pragma once
+
+#include <Mui_Base.h>
+
+using namespace Mui;
+
+//lz4块格式的软件实现 压缩数据与lz4块格式兼容 不包含帧格式
+//压缩结果可以由lz4库的LZ4_decompress_safe解压 也可以解压LZ4_compress_default的结果 参见MUI_CFG_ENABLE_LZ4LIB
+
+//压缩size字节数据时需要的最大缓冲区尺寸
+_m_size LZ4Block_CompressBound(_m_size size);
+
+/*压缩数据
+* @param capacity - dst容量 不能小于LZ4Block_CompressBound(size)
+*
+* @return 压缩后的字节数 dst容量不足返回0
+*/
+_m_size LZ4Block_Compress(const _m_byte* src, _m_size size, _m_byte* dst, _m_size capacity);
+
+/*解压数据 会检查输入和输出边界
+* @param capacity - dst容量
+*
+* @return 解压后的字节数 数据无效或dst容量不足返回0
+*/
+_m_size LZ4Block_Decompress(const _m_byte* src, _m_size size, _m_byte* dst, _m_size capacity);
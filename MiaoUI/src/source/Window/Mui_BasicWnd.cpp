@@ -25,12 +25,103 @@
 
 namespace Mui::Window
 {
+	namespace
+	{
+		_m_rect UnionRect(const _m_rect& a, const _m_rect& b)
+		{
+			return { Helper::M_MIN(a.left, b.left), Helper::M_MIN(a.top, b.top),
+				Helper::M_MAX(a.right, b.right), Helper::M_MAX(a.bottom, b.bottom) };
+		}
+
+		_m_long64 RectArea(const _m_rect& rc)
+		{
+			return (_m_long64)rc.GetWidth() * rc.GetHeight();
+		}
+
+		/*两个矩形是否值得合并
+		 * 外接矩形中不属于任一矩形的面积不超过两者面积之和的1/4时合并
+		 * 包含关系和边长对齐的共边相邻矩形没有浪费面积 总是会被合并
+		 * 交叉(如十字形)或错位相邻的矩形浪费面积可能较大 此时不合并
+		 */
+		bool ShouldMerge(const _m_rect& a, const _m_rect& b)
+		{
+			const _m_rect inter = { Helper::M_MAX(a.left, b.left), Helper::M_MAX(a.top, b.top),
+				Helper::M_MIN(a.right, b.right), Helper::M_MIN(a.bottom, b.bottom) };
+			_m_long64 interArea = 0;
+			if (inter.right > inter.left && inter.bottom > inter.top)
+				interArea = RectArea(inter);
+
+			const _m_long64 area = RectArea(a) + RectArea(b);
+			const _m_long64 waste = RectArea(UnionRect(a, b)) - (area - interArea);
+			return waste * 4 <= area;
+		}
+	}
+
+	void UIDirtyRegion::Add(const _m_rect& rect)
+	{
+		if (m_full || rect.right <= rect.left || rect.bottom <= rect.top)
+			return;
+
+		//合并后的矩形可能与其他矩形满足合并条件 重复直到没有可合并的矩形
+		_m_rect merged = rect;
+		for (size_t i = 0; i < m_rects.size();)
+		{
+			if (ShouldMerge(m_rects[i], merged))
+			{
+				merged = UnionRect(m_rects[i], merged);
+				m_rects.erase(m_rects.begin() + (ptrdiff_t)i);
+				i = 0;
+				continue;
+			}
+			++i;
+		}
+		m_rects.push_back(merged);
+
+		if (m_rects.size() > MaxRects)
+			Collapse();
+	}
+
+	void UIDirtyRegion::AddFull()
+	{
+		m_full = true;
+		m_rects.clear();
+	}
+
+	_m_rect UIDirtyRegion::GetBounds() const
+	{
+		if (m_full || m_rects.empty())
+			return { 0, 0, 0, 0 };
+		_m_rect bounds = m_rects[0];
+		for (size_t i = 1; i < m_rects.size(); ++i)
+			bounds = UnionRect(bounds, m_rects[i]);
+		return bounds;
+	}
+
+	void UIDirtyRegion::Clear()
+	{
+		m_full = false;
+		m_rects.clear();
+	}
+
+	void UIDirtyRegion::Swap(UIDirtyRegion& region) noexcept
+	{
+		m_rects.swap(region.m_rects);
+		std::swap(m_full, region.m_full);
+	}
+
+	void UIDirtyRegion::Collapse()
+	{
+		const _m_rect bounds = GetBounds();
+		m_rects.clear();
+		m_rects.push_back(bounds);
+	}
+
 	UIWindowBasic::UIWindowBasic(Render::Def::MRender* render)
-		: MThreadT([this] { ThreadProc(); }), m_rootBox(new Ctrl::UIControl()), m_drawCmdList(255)
+		: MThreadT([this] { ThreadProc(); }), m_rootBox(new Ctrl::UIControl())
 	{
 		m_render = render;
 		m_renderCmd = new Render::MRenderCmd(render);
-		m_resourceMgr = new UIResourceMgr(m_renderCmd);
+		m_resourceMgr = new UIResourceMgr(m_renderCmd, this);
 
 		m_timer = new MTimers();
 
@@ -67,6 +158,19 @@ namespace Mui::Window
 	UIWindowBasic::~UIWindowBasic()
 	{
 		Stop();
+		//异步加载的位图完成时会更新控件树
+		m_resourceMgr->StopDecode();
+		//投递的布局任务会访问控件树
+		try
+		{
+			m_renderCmd->WaitPost();
+		}
+		catch (...)
+		{
+#ifdef _DEBUG
+			_M_OutErrorDbg_(L"异步任务发生异常", false);
+#endif
+		}
 		m_dbgFrame = nullptr;
 		delete m_xmlUI;
 		delete m_rootBox;
@@ -84,26 +188,36 @@ namespace Mui::Window
 
 	void UIWindowBasic::UpdateLayout(MPCRect rect)
 	{
-		m_renderCmd->RunTask([this]
-		{
-			const UIRect&& rcClient = GetWindowRect(true);
-			auto ctrl = m_rootBox;
-			ctrl->SetSize(rcClient.GetWidth(), rcClient.GetHeight(), false);
-			ctrl->UINodeBase::m_data.Frame = rcClient.ToRectT<float>();
-			ctrl->UINodeBase::m_data.ClipFrame = rcClient.ToRectT<float>();
-			ctrl->UINodeBase::m_data.Align.Layout(ctrl, 0);
-			ctrl->UpdateDisplay();
-		});
+		m_renderCmd->RunTask([this] { LayoutProc(); });
+	}
+
+	void UIWindowBasic::PostLayout()
+	{
+		m_renderCmd->Post([this] { LayoutProc(); });
+	}
+
+	void UIWindowBasic::LayoutProc()
+	{
+		const UIRect&& rcClient = GetWindowRect(true);
+		auto ctrl = m_rootBox;
+		ctrl->SetSize(rcClient.GetWidth(), rcClient.GetHeight(), false);
+		ctrl->UINodeBase::m_data.Frame = rcClient.ToRectT<float>();
+		ctrl->UINodeBase::m_data.ClipFrame = rcClient.ToRectT<float>();
+		ctrl->UINodeBase::m_data.Align.Layout(ctrl, 0);
+		ctrl->UpdateDisplay();
 	}
 
 	void UIWindowBasic::UpdateDisplay(MPCRect rect)
 	{
 		if (m_renderMode) return;
-		_m_rect updateRect;
-		if (rect)
-			updateRect = *rect;
-		if(!m_drawCmdList.isFull())
-			m_drawCmdList.push({ updateRect.left, updateRect.top, updateRect.right, updateRect.bottom });
+		{
+			std::lock_guard lock(m_dirtyLock);
+			//{0}与nullptr一致 表示整个窗口
+			if (rect && (rect->left || rect->top || rect->right || rect->bottom))
+				m_dirtyRegion.Add(*rect);
+			else
+				m_dirtyRegion.AddFull();
+		}
 		ResumeThread();
 	}
 
@@ -285,10 +399,10 @@ namespace Mui::Window
 			{
 				auto rc = GetWindowRect(true);
 				m_render->Resize(rc.GetWidth(), rc.GetHeight());
-				//更新布局
-				UpdateLayout(nullptr);
 				m_updateCache = true;
 			});
+			//更新布局 在渲染线程内投递会直接执行 需要在RunTask返回后投递
+			PostLayout();
 		}
 		break;
 		case M_MOUSE_LEAVE:
@@ -451,7 +565,7 @@ namespace Mui::Window
 		loadResource(m_rootBox);
 	}
 
-	void UIWindowBasic::RenderControlTree(const _m_rect_t<int>* dirtyArea)
+	void UIWindowBasic::RenderControlTree(const _m_rect_t<int>* dirtyArea, const std::vector<_m_rect>* dirtyRects)
 	{
 		if (!m_inited || IsMinimize()) return;
 
@@ -469,7 +583,10 @@ namespace Mui::Window
 			}
 
 			_m_rect dirtyAreaRect;
-			if (dirtyArea)
+			//空区域为全部区域
+			if (dirtyArea && dirtyArea->left == 0 && dirtyArea->top == 0 && dirtyArea->right == 0 && dirtyArea->bottom == 0)
+				dirtyAreaRect = { 0, 0, cvWidth, cvHeight };
+			else if (dirtyArea)
 			{
 				dirtyAreaRect = *dirtyArea;
 				//限定更新区域不能超过画布尺寸
@@ -482,21 +599,47 @@ namespace Mui::Window
 			}
 			m_renderCmd->SetCanvas(m_renderCmd->GetRenderCanvas());
 			m_renderCmd->BeginDraw();
-			//清空脏区域
-			if (!dirtyArea && !m_renderMode)
+			//绘制子控件 窗口外的控件总是跳过 只呈现脏区域时跳过与所有脏矩形都不相交的控件
+			std::vector<_m_rect> cullRects;
+			if (dirtyArea && IsPresentDirtyOnly())
 			{
-				m_renderCmd->PushClipRect(dirtyAreaRect);
-				m_renderCmd->Clear();
-				m_renderCmd->PopClipRect();
+				if (dirtyRects)
+				{
+					for (_m_rect rect : *dirtyRects)
+					{
+						rect.left = Helper::M_MAX(rect.left, 0);
+						rect.top = Helper::M_MAX(rect.top, 0);
+						rect.right = Helper::M_MIN(rect.right, cvWidth);
+						rect.bottom = Helper::M_MIN(rect.bottom, cvHeight);
+						if (rect.right > rect.left && rect.bottom > rect.top)
+							cullRects.push_back(rect);
+					}
+				}
+				if (cullRects.empty())
+					cullRects.push_back(dirtyAreaRect);
+			}
+			else
+				cullRects.push_back({ 0, 0, cvWidth, cvHeight });
+
+			//清空脏区域 只呈现脏区域时逐个清空脏矩形 矩形之间的部分保留上一帧的内容 呈现外接矩形时不会变化
+			if (dirtyArea && IsPresentDirtyOnly())
+			{
+				for (const auto& rect : cullRects)
+				{
+					m_renderCmd->PushClipRect(rect);
+					m_renderCmd->Clear();
+					m_renderCmd->PopClipRect();
+				}
 			}
 			else
 				m_renderCmd->Clear();
 
-			//绘制子控件
 			renderData _param;
+			//释放不再绘制的图像Style持有的共享位图
+			m_resourceMgr->BeginFrame();
 			try 
 			{
-				m_renderRoot->RenderTree(&_param);
+				m_renderRoot->RenderTree(&_param, cullRects.data(), cullRects.size());
 			}
 			catch(...)
 			{
@@ -515,15 +658,26 @@ namespace Mui::Window
 
 	void UIWindowBasic::ThreadProc() try
 	{
-		//绘制任务
+		//绘制任务 取出两帧之间累积的全部脏区域 合并为一帧绘制
+		UIDirtyRegion region;
+		{
+			std::lock_guard dirtyLock(m_dirtyLock);
+			region.Swap(m_dirtyRegion);
+		}
 		_m_rect_t dirtyArea { 0 };
-		if (!m_drawCmdList.isEmpty() && !m_renderMode)
-			m_drawCmdList.pop(dirtyArea);
-		RenderControlTree(&dirtyArea);
+		//外接矩形用于一次呈现 各个脏矩形用于清空和裁剪控件
+		if (!m_renderMode && !region.IsEmpty())
+			dirtyArea = region.GetBounds();
+		RenderControlTree(&dirtyArea, m_renderMode ? nullptr : &region.GetRects());
 
 		using namespace std::chrono;
 		std::unique_lock lock = GetLock();
-		if (!m_renderMode && m_drawCmdList.isEmpty() && m_threadTaskList.empty())
+		bool dirtyEmpty;
+		{
+			std::lock_guard dirtyLock(m_dirtyLock);
+			dirtyEmpty = m_dirtyRegion.IsEmpty();
+		}
+		if (!m_renderMode && dirtyEmpty && m_threadTaskList.empty())
 		{
 			MThreadT::Pause(lock);
 		}
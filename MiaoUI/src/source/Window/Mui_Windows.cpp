@@ -295,6 +295,12 @@ namespace Mui::Window
 		//EndPaint(m_hWnd, &pt);
 	}
 
+	bool UIWindowsWnd::IsPresentDirtyOnly()
+	{
+		//分层窗口只更新prcDirty区域
+		return m_layerWnd;
+	}
+
 	bool UIWindowsWnd::InitRender(MRenderCmd* render)
 	{
 		if (render)
@@ -0,0 +1,410 @@
+﻿#include "Benchmark.h"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+using namespace Mui;
+
+namespace
+{
+	/*只提供绘制范围的Node 用于测试RenderTree的裁剪
+	* @param trace - 不为空时记录调用序列 OnRender记录id*2 OnRenderChildEnd记录id*2+1
+	*/
+	class BenchNode : public Render::MRenderNode
+	{
+	public:
+		BenchNode(_m_rect rect, std::vector<int>* trace = nullptr, int id = 0)
+			: m_rect(rect), m_trace(trace), m_id(id) {}
+
+		void AddChild(BenchNode* node) { AddChildNode(node); }
+		void Hide() { Visible(false); }
+
+	protected:
+		void OnRender(Render::MRenderCmd*, void*) override
+		{
+			if (m_trace)
+				m_trace->push_back(m_id * 2);
+		}
+		void OnRenderChildEnd(Render::MRenderCmd*, void*) override
+		{
+			if (m_trace)
+				m_trace->push_back(m_id * 2 + 1);
+		}
+		bool GetRenderRect(_m_rect& rect) override
+		{
+			rect = m_rect;
+			return true;
+		}
+
+	private:
+		_m_rect m_rect;
+		std::vector<int>* m_trace = nullptr;
+		int m_id = 0;
+	};
+
+	//独立的渲染命令队列 不与窗口的渲染线程共用
+	struct BenchRender
+	{
+		Render::MRender* render = nullptr;
+		Render::MRenderCmd* cmd = nullptr;
+
+		BenchRender(_m_uint width, _m_uint height)
+		{
+			render = new Render::MRender_GDIP();
+			cmd = new Render::MRenderCmd(render);
+			if (!cmd->InitRender(width, height))
+			{
+				Release();
+				return;
+			}
+		}
+		~BenchRender() { Release(); }
+
+		void Release()
+		{
+			if (render)
+				render->Release();
+			delete cmd;
+			render = nullptr;
+			cmd = nullptr;
+		}
+	};
+}
+
+//每帧10000次纯色填充 每次修改画刷颜色 比较逐条同步调用和记录模式
+MUI_BENCH(RenderFill)
+{
+	constexpr _m_size fills = 10000;
+	constexpr _m_size frames = 20;
+	BenchRender bench(256, 256);
+	if (!bench.cmd)
+		return;
+	const auto cmd = bench.cmd;
+	{
+		auto canvas = cmd->CreateCanvas(256, 256);
+		auto brush = cmd->CreateBrush(Color::M_RGBA(0, 120, 215, 255));
+		if (!canvas || !brush)
+			return;
+
+		const std::pair<const wchar_t*, bool> modes[] = { { L"task.frame", false }, { L"recorded.frame", true } };
+		for (auto& [name, record] : modes)
+		{
+			runner.Measure(name, frames, [&](_m_size)
+			{
+				if (record)
+					cmd->BeginRecord();
+				cmd->BeginDraw();
+				cmd->SetCanvas(canvas);
+				for (_m_size i = 0; i < fills; ++i)
+				{
+					brush->SetColor(Color::M_RGBA((_m_byte)i, 120, 215, 255));
+					cmd->FillRectangle(UIRect((int)(i % 64) * 4, (int)(i / 64 % 64) * 4, 4, 4), brush);
+				}
+				cmd->ResetCanvas();
+				cmd->EndDraw();
+				if (record)
+					cmd->EndRecord();
+			});
+		}
+	}
+}
+
+//4个线程各投递50000个异步任务 与逐个同步调用比较 每个线程最后的同步调用检查之前的投递均已执行
+MUI_BENCH(RenderPost)
+{
+	constexpr _m_size threads = 4;
+	constexpr _m_size posts = 50000;
+	BenchRender bench(64, 64);
+	if (!bench.cmd)
+		return;
+	const auto cmd = bench.cmd;
+
+	for (int post = 0; post < 2; ++post)
+	{
+		std::atomic<_m_size> done = 0;
+		std::atomic<_m_size> outOfOrder = 0;
+		const auto begin = std::chrono::steady_clock::now();
+		std::vector<std::thread> list;
+		for (_m_size t = 0; t < threads; ++t)
+		{
+			list.emplace_back([&, post]
+			{
+				_m_size count = 0;
+				for (_m_size i = 0; i < posts; ++i)
+				{
+					if (post)
+						cmd->Post([&count] { count++; });
+					else
+						cmd->RunTask([&count] { count++; });
+				}
+				cmd->RunTask([&] { outOfOrder += count != posts; });
+				done += count;
+			});
+		}
+		for (auto& thread : list)
+			thread.join();
+		const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - begin).count() / (double)(threads * posts);
+		const std::wstring mode = post ? L"post" : L"task";
+		runner.Report(mode, ns, L"ns/op");
+		runner.Report(mode + L".done", (double)done, L"");
+		runner.Report(mode + L".outOfOrder", (double)outOfOrder, L"");
+	}
+}
+
+//渲染线程执行100ms任务期间 8个线程各提交100次同步任务 统计任务队列的锁竞争
+MUI_BENCH(RenderContention)
+{
+	constexpr _m_size threads = 8;
+	constexpr _m_size calls = 100;
+	constexpr _m_size rounds = 5;
+	BenchRender bench(64, 64);
+	if (!bench.cmd)
+		return;
+	const auto cmd = bench.cmd;
+	cmd->ResetStats();
+
+	runner.Measure(L"round", rounds, [&](_m_size)
+	{
+		cmd->Post([] { std::this_thread::sleep_for(std::chrono::milliseconds(100)); });
+		std::vector<std::thread> list;
+		for (_m_size t = 0; t < threads; ++t)
+		{
+			list.emplace_back([cmd]
+			{
+				for (_m_size i = 0; i < calls; ++i)
+					cmd->RunTask([] {});
+			});
+		}
+		for (auto& thread : list)
+			thread.join();
+	});
+
+	const auto stats = cmd->GetStats();
+	runner.Report(L"enqueue", (double)stats.enqueueCount, L"");
+	runner.Report(L"contended", (double)stats.contendedCount, L"");
+	runner.Report(L"lockWait.avg", stats.enqueueCount ? (double)stats.lockWaitTime / (double)stats.enqueueCount : 0.0, L"us");
+	runner.Report(L"lockWait.max", (double)stats.lockWaitMax, L"us");
+	runner.Report(L"batch", (double)stats.batchCount, L"");
+	runner.Report(L"wake", (double)stats.wakeCount, L"");
+}
+
+//每帧在1280x720的窗口中随机添加16个分散的小脏矩形 统计合并耗时和按各个脏矩形裁剪相比外接矩形的面积
+MUI_BENCH(DirtyRegion)
+{
+	constexpr _m_size frames = 10000;
+	constexpr _m_size adds = 16;
+	std::mt19937 random(1);
+	std::vector<_m_rect> input(frames * adds);
+	for (auto& rect : input)
+	{
+		const int x = (int)(random() % 1200), y = (int)(random() % 680);
+		rect = { x, y, x + 16 + (int)(random() % 64), y + 16 + (int)(random() % 40) };
+	}
+
+	Window::UIDirtyRegion region;
+	double rectArea = 0, boundsArea = 0, rectCount = 0;
+	runner.Measure(L"frame", frames, [&](_m_size i)
+	{
+		region.Clear();
+		for (_m_size n = 0; n < adds; ++n)
+			region.Add(input[i * adds + n]);
+		for (auto& rect : region.GetRects())
+			rectArea += (double)rect.GetWidth() * rect.GetHeight();
+		const _m_rect bounds = region.GetBounds();
+		boundsArea += (double)bounds.GetWidth() * bounds.GetHeight();
+		rectCount += (double)region.GetRects().size();
+	});
+	runner.Report(L"rects", rectCount / frames, L"");
+	runner.Report(L"rectArea", rectArea / frames, L"px");
+	runner.Report(L"boundsArea", boundsArea / frames, L"px");
+	runner.Report(L"cullRatio", boundsArea != 0 ? rectArea / boundsArea : 0.0, L"");
+}
+
+//绘制演示程序资源文件中的全部图像Style 比较打包到图集前后的每帧耗时和共享位图数量
+MUI_BENCH(StyleAtlas)
+{
+	constexpr _m_size frames = 50;
+	const std::wstring path = Bench::Runner::DemoPackPath();
+	const auto names = Bench::Runner::ListStyles(path);
+	if (names.empty())
+		return;
+	BenchRender bench(512, 512);
+	if (!bench.cmd)
+		return;
+	const auto cmd = bench.cmd;
+	{
+		UIResourceMgr mgr(cmd);
+		if (!mgr.AddResourcePath(path, Bench::Runner::DemoPackKey))
+			return;
+		std::vector<UIStyle*> styles;
+		for (auto& name : names)
+		{
+			if (const auto style = mgr.FindStyle(name); style && style->GetType() == UIStyleType::Image)
+				styles.push_back(style);
+		}
+		auto canvas = cmd->CreateCanvas(512, 512);
+		if (styles.empty() || !canvas)
+			return;
+
+		auto paint = [&](_m_size)
+		{
+			cmd->BeginDraw();
+			cmd->SetCanvas(canvas);
+			for (size_t i = 0; i < styles.size(); ++i)
+			{
+				const _m_rect dest = UIRect((int)(i % 16) * 32, (int)(i / 16 % 16) * 32, 32, 32);
+				styles[i]->PaintStyle(cmd, &dest, 255, 0, styles[i]->GetPartCount());
+			}
+			cmd->ResetCanvas();
+			cmd->EndDraw();
+		};
+		auto report = [&](const std::wstring& mode)
+		{
+			const auto stats = mgr.GetBitmapCacheStats();
+			runner.Report(mode + L".bitmaps", (double)stats.count, L"");
+			runner.Report(mode + L".uniqueBytes", (double)stats.uniqueBytes / 1024.0, L"KB");
+		};
+
+		runner.Report(L"styles", (double)styles.size(), L"");
+		runner.Measure(L"plain.frame", frames, paint);
+		report(L"plain");
+		runner.Report(L"pages", (double)mgr.BuildStyleAtlas(), L"");
+		runner.Measure(L"atlas.frame", frames, paint);
+		report(L"atlas");
+	}
+}
+
+//1000x1000区域内100个面板各含100个子Node 比较不裁剪 单个脏矩形 对角两个脏矩形的外接矩形和两个矩形分别裁剪
+MUI_BENCH(RenderCull)
+{
+	constexpr _m_size frames = 1000;
+	BenchNode* root = new BenchNode({ 0, 0, 1000, 1000 });
+	auto nodeRoot = new Render::MNodeRoot(root);
+	std::vector<BenchNode*> nodes;
+	for (int panel = 0; panel < 100; ++panel)
+	{
+		const int px = panel % 10 * 100, py = panel / 10 * 100;
+		auto node = new BenchNode({ px, py, px + 100, py + 100 });
+		root->AddChild(node);
+		nodes.push_back(node);
+		for (int item = 0; item < 100; ++item)
+		{
+			const int x = px + item % 10 * 10, y = py + item / 10 * 10;
+			auto child = new BenchNode({ x, y, x + 10, y + 10 });
+			node->AddChild(child);
+			nodes.push_back(child);
+		}
+	}
+
+	const _m_rect corner[] = { { 0, 0, 50, 50 }, { 950, 950, 1000, 1000 } };
+	const _m_rect bounds = { 0, 0, 1000, 1000 };
+	const std::tuple<const wchar_t*, const _m_rect*, size_t> modes[] =
+	{
+		{ L"none", nullptr, 1 },
+		{ L"single", corner, 1 },
+		{ L"bounds", &bounds, 1 },
+		{ L"rects", corner, 2 }
+	};
+	for (auto& [name, cull, count] : modes)
+	{
+		runner.Measure(std::wstring(name) + L".frame", frames, [&](_m_size)
+		{
+			nodeRoot->RenderTree(nullptr, cull, count);
+		});
+		runner.Report(std::wstring(name) + L".visited", (double)nodeRoot->GetVisitedCount(), L"");
+		runner.Report(std::wstring(name) + L".drawn", (double)nodeRoot->GetDrawnCount(), L"");
+	}
+
+	//先释放根Node 一次移除整个绘制列表
+	delete root;
+	for (auto node : nodes)
+		delete node;
+	delete nodeRoot;
+}
+
+/*随机生成200棵各300个Node的树 每棵树使用1到4个随机裁剪区域 比较裁剪与不裁剪时的调用序列
+* 裁剪后的序列应等于不裁剪的序列去掉自身或祖先与所有裁剪区域都不相交的Node的调用
+* 根Node不在绘制列表中 其OnRenderChildEnd总是被调用 部分Node随机隐藏
+*/
+MUI_BENCH(RenderCullCheck)
+{
+	constexpr int trees = 200;
+	constexpr int nodeCount = 300;
+	std::mt19937 random(1);
+	auto range = [&random](int min, int max) { return min + (int)(random() % (unsigned)(max - min)); };
+	auto intersect = [](const _m_rect& a, const _m_rect& b)
+	{
+		return a.left < b.right && a.right > b.left && a.top < b.bottom && a.bottom > b.top;
+	};
+
+	std::vector<int> trace;
+	_m_size mismatch = 0, events = 0;
+	for (int tree = 0; tree < trees; ++tree)
+	{
+		//子Node的范围位于父Node之内 父Node的索引总是小于子Node
+		std::vector<BenchNode*> nodes;
+		std::vector<int> parent;
+		std::vector<_m_rect> rects;
+		rects.push_back({ 0, 0, 1000, 1000 });
+		parent.push_back(-1);
+		nodes.push_back(new BenchNode(rects[0], &trace, 0));
+		auto nodeRoot = new Render::MNodeRoot(nodes[0]);
+		for (int i = 1; i < nodeCount; ++i)
+		{
+			const int p = range(0, i);
+			const _m_rect& area = rects[p];
+			_m_rect rect;
+			rect.left = range(area.left, area.right);
+			rect.top = range(area.top, area.bottom);
+			rect.right = range(rect.left + 1, area.right + 1);
+			rect.bottom = range(rect.top + 1, area.bottom + 1);
+			rects.push_back(rect);
+			parent.push_back(p);
+			nodes.push_back(new BenchNode(rect, &trace, i));
+			nodes[p]->AddChild(nodes[i]);
+			if (range(0, 16) == 0)
+				nodes[i]->Hide();
+		}
+
+		std::vector<_m_rect> cull(range(1, 5));
+		for (auto& rect : cull)
+		{
+			rect.left = range(0, 1000);
+			rect.top = range(0, 1000);
+			rect.right = rect.left + range(1, 500);
+			rect.bottom = rect.top + range(1, 500);
+		}
+		std::vector<bool> keep(nodeCount, true);
+		for (int i = 1; i < nodeCount; ++i)
+		{
+			keep[i] = keep[parent[i]] && std::any_of(cull.begin(), cull.end(),
+				[&](const _m_rect& rect) { return intersect(rects[i], rect); });
+		}
+
+		trace.clear();
+		nodeRoot->RenderTree(nullptr);
+		std::vector<int> expected;
+		for (const int item : trace)
+		{
+			if (keep[item / 2])
+				expected.push_back(item);
+		}
+		trace.clear();
+		nodeRoot->RenderTree(nullptr, cull.data(), cull.size());
+		events += trace.size();
+		if (trace != expected)
+			mismatch++;
+
+		//先释放根Node 一次移除整个绘制列表
+		for (auto node : nodes)
+			delete node;
+		delete nodeRoot;
+	}
+	runner.Report(L"trees", (double)trees, L"");
+	runner.Report(L"events", (double)events / trees, L"");
+	runner.Report(L"mismatch", (double)mismatch, L"");
+}
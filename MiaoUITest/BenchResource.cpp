@@ -0,0 +1,461 @@
+﻿#include "Benchmark.h"
+#include <FileSystem/DreamMoonRes.h>
+#include <Psapi.h>
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace Mui;
+
+namespace
+{
+	const std::wstring benchKey = L"12345678";
+
+	//生成资源数据 每256字节中前192字节为界面XML片段 其余为随机数据
+	void FillData(std::vector<_m_byte>& data, _m_size index)
+	{
+		const std::string xml = "<UIButton name=\"button" + std::to_string(index) + "\" frame=\"10,10,100,30\" text=\"Button\" />\n";
+		std::mt19937 random((unsigned)index);
+		for (_m_size n = 0; n < data.size(); ++n)
+			data[n] = n % 256 < 192 ? (_m_byte)xml[n % xml.size()] : (_m_byte)random();
+	}
+
+	/*生成测试资源文件
+	* @param path - 保存路径
+	* @param count - 资源数量
+	* @param size - 每个资源的数据尺寸
+	* @param blockSize - 不为0时以块模式存储
+	* @param compress - 压缩存储 保存为v2格式
+	* @param v2 - 不压缩时也保存为v2格式
+	*/
+	bool MakePack(const std::wstring& path, _m_size count, _m_size size, _m_size blockSize = 0, bool compress = false, bool v2 = false)
+	{
+		DMResources res;
+		if (!res.CreateResource(L"bench"))
+			return false;
+		std::vector<_m_byte> data(size);
+		for (_m_size i = 0; i < count; ++i)
+		{
+			FillData(data, i);
+			DMResKey key;
+			key.res = UIResource(data.data(), data.size());
+			key.block = blockSize != 0;
+			key.blockSize = (unsigned long)blockSize;
+			key.compress = compress;
+			if (!res.AddResource(key, L"res_" + std::to_wstring(i), benchKey))
+				return false;
+		}
+		return res.SaveResource(path, compress || v2);
+	}
+
+	//以无缓冲方式打开一次文件 没有其他打开的句柄时系统会丢弃该文件的缓存页 之后的读取需要访问磁盘
+	void PurgeFileCache(const std::wstring& path)
+	{
+		const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+	}
+}
+
+//10000个资源的资源文件中按名称查找 只读取资源尺寸 不读取和解密数据
+MUI_BENCH(ResLookup)
+{
+	constexpr _m_size count = 10000;
+	const std::wstring path = Bench::Runner::TempPath(L"lookup.dmres");
+	if (!MakePack(path, count, 64))
+		return;
+
+	std::vector<std::wstring> names(count);
+	for (_m_size i = 0; i < count; ++i)
+		names[i] = L"res_" + std::to_wstring(i);
+	std::shuffle(names.begin(), names.end(), std::mt19937(1));
+
+	const std::pair<const wchar_t*, int> modes[] = { { L"file", 0 }, { L"memory", 1 }, { L"mapped", 2 } };
+	for (auto& [mode, type] : modes)
+	{
+		DMResources res;
+		const bool loaded = type == 2 ? res.LoadResourceMapped(path) : res.LoadResource(path, type == 1);
+		if (!loaded)
+			continue;
+		_m_size found = 0;
+		runner.Measure(std::wstring(mode) + L".hit", count, [&](_m_size i)
+		{
+			found += res.ReadResourceSize(names[i], DataRes) != 0;
+		});
+		runner.Measure(std::wstring(mode) + L".miss", count, [&](_m_size i)
+		{
+			found += res.ReadResourceSize(names[i] + L"_", DataRes) != 0;
+		});
+		runner.Report(std::wstring(mode) + L".found", (double)found, L"");
+	}
+	DeleteFileW(path.c_str());
+}
+
+//以1KB为单位读取块模式资源 比较使用秘钥派生缓存和每次重新派生 并校验两者输出相同
+MUI_BENCH(ResBlockRead)
+{
+	constexpr _m_size size = 4 * 1024 * 1024;
+	constexpr _m_size block = 1024;
+	const std::wstring path = Bench::Runner::TempPath(L"block.dmres");
+	if (!MakePack(path, 1, size, block))
+		return;
+
+	DMResources res;
+	if (res.LoadResource(path, false))
+	{
+		std::vector<_m_byte> output[2];
+		for (int cached = 1; cached >= 0; --cached)
+		{
+			res.EnableKeyCache(cached);
+			auto& out = output[cached];
+			out.resize(size);
+			runner.Measure(cached ? L"cached.1KB" : L"uncached.1KB", size / block, [&](_m_size i)
+			{
+				_m_size retlen = 0;
+				UIResource data = res.ReadResourceBlock(L"res_0", benchKey, (_m_uint)(i * block), block, &retlen);
+				if (data.data && retlen <= block)
+					memcpy(out.data() + i * block, data.data, retlen);
+				data.Release();
+			});
+		}
+		res.EnableKeyCache(true);
+		runner.Report(L"identical", output[0] == output[1] ? 1.0 : 0.0, L"");
+	}
+	res.CloseResource();
+	DeleteFileW(path.c_str());
+}
+
+//编码和解码16MB的块模式资源 比较线程池并行处理和在当前线程依次处理 并校验两者的输出相同
+MUI_BENCH(ResBlockCipher)
+{
+	constexpr _m_size size = 16 * 1024 * 1024;
+	constexpr _m_size block = 64 * 1024;
+	std::vector<_m_byte> data(size);
+	FillData(data, 0);
+
+	std::vector<_m_byte> decoded[2];
+	std::wstring saved[2];
+	for (int parallel = 1; parallel >= 0; --parallel)
+	{
+		DMResources::EnableParallel(parallel);
+		const std::wstring mode = parallel ? L"pool" : L"serial";
+		DMResources res;
+		if (!res.CreateResource(L"bench"))
+			continue;
+		DMResKey key;
+		key.res = UIResource(data.data(), data.size());
+		key.block = true;
+		key.blockSize = (unsigned long)block;
+
+		auto begin = std::chrono::steady_clock::now();
+		if (!res.AddResource(key, L"res_0", benchKey))
+			continue;
+		double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		runner.Report(mode + L".encode", (double)size / (1024.0 * 1024.0) / sec, L"MB/s");
+
+		begin = std::chrono::steady_clock::now();
+		UIResource out = res.ReadResource(L"res_0", benchKey, DataRes).res;
+		sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		runner.Report(mode + L".decode", (double)size / (1024.0 * 1024.0) / sec, L"MB/s");
+		if (out.data)
+			decoded[parallel].assign(out.data, out.data + out.size);
+		out.Release();
+
+		//保存的文件包含编码后的数据 用于比较两种方式的编码结果
+		saved[parallel] = Bench::Runner::TempPath(parallel ? L"cipher_pool.dmres" : L"cipher_serial.dmres");
+		if (!res.SaveResource(saved[parallel]))
+			saved[parallel].clear();
+	}
+	DMResources::EnableParallel(true);
+
+	auto readFile = [](const std::wstring& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	};
+	bool encoded = false;
+	if (!saved[0].empty() && !saved[1].empty())
+	{
+		const auto pool = readFile(saved[1]);
+		encoded = !pool.empty() && pool == readFile(saved[0]);
+	}
+	runner.Report(L"encodeIdentical", encoded ? 1.0 : 0.0, L"");
+	runner.Report(L"decodeIdentical", decoded[0] == decoded[1] && decoded[0] == data ? 1.0 : 0.0, L"");
+	for (auto& path : saved)
+	{
+		if (!path.empty())
+			DeleteFileW(path.c_str());
+	}
+}
+
+//多个线程同时从文件模式和映射模式的资源读取64KB的资源 输出总吞吐量
+MUI_BENCH(ResParallelRead)
+{
+	constexpr _m_size count = 256;
+	constexpr _m_size size = 64 * 1024;
+	constexpr _m_size reads = 2048;
+	const std::wstring path = Bench::Runner::TempPath(L"parallel.dmres");
+	if (!MakePack(path, count, size))
+		return;
+
+	for (int mapped = 0; mapped < 2; ++mapped)
+	{
+		DMResources res;
+		if (!(mapped ? res.LoadResourceMapped(path) : res.LoadResource(path, false)))
+			continue;
+		for (_m_size threadCount : { 1, 2, 4, 8 })
+		{
+			const auto begin = std::chrono::steady_clock::now();
+			std::vector<std::thread> threads;
+			for (_m_size t = 0; t < threadCount; ++t)
+			{
+				threads.emplace_back([&, t]
+				{
+					std::mt19937 random((unsigned)t);
+					for (_m_size i = 0; i < reads / threadCount; ++i)
+						res.ReadResource(L"res_" + std::to_wstring(random() % count), benchKey, DataRes).res.Release();
+				});
+			}
+			for (auto& thread : threads)
+				thread.join();
+			const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+			const std::wstring name = std::wstring(mapped ? L"mapped." : L"file.") + std::to_wstring(threadCount) + L"threads";
+			runner.Report(name, (double)(reads * size) / (1024.0 * 1024.0) / sec, L"MB/s");
+		}
+	}
+	DeleteFileW(path.c_str());
+}
+
+//加载资源文件并读取全部资源 比较压缩和未压缩的资源文件
+//cold每次加载前丢弃文件的系统缓存 warm为文件已在系统缓存中
+MUI_BENCH(ResColdLoad)
+{
+	constexpr _m_size count = 200;
+	constexpr _m_size size = 64 * 1024;
+	for (int compress = 0; compress < 2; ++compress)
+	{
+		const std::wstring path = Bench::Runner::TempPath(compress ? L"cold_lz4.dmres" : L"cold.dmres");
+		if (!MakePack(path, count, size, 0, compress))
+			continue;
+		const std::wstring mode = compress ? L"lz4" : L"plain";
+		WIN32_FILE_ATTRIBUTE_DATA attr = { 0 };
+		if (GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attr))
+			runner.Report(mode + L".fileSize", (double)attr.nFileSizeLow / 1024.0, L"KB");
+
+		for (int cold = 1; cold >= 0; --cold)
+		{
+			constexpr _m_size rounds = 10;
+			double total = 0;
+			for (_m_size r = 0; r < rounds; ++r)
+			{
+				if (cold)
+					PurgeFileCache(path);
+				const auto begin = std::chrono::steady_clock::now();
+				DMResources res;
+				if (!res.LoadResource(path, false))
+					break;
+				for (_m_size i = 0; i < count; ++i)
+					res.ReadResource(L"res_" + std::to_wstring(i), benchKey, DataRes).res.Release();
+				total += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+			}
+			runner.Report(mode + (cold ? L".cold" : L".warm"), total / rounds, L"ms");
+		}
+		DeleteFileW(path.c_str());
+	}
+}
+
+//比较直接从资源文件读取和经过资源管理器读取的耗时 资源管理器记录统计 以及设置跟踪回调时的耗时
+MUI_BENCH(ResStats)
+{
+	constexpr _m_size count = 1000;
+	constexpr _m_size reads = 20000;
+	const std::wstring path = Bench::Runner::TempPath(L"stats.dmres");
+	if (!MakePack(path, count, 256))
+		return;
+
+	std::vector<std::wstring> names(count);
+	for (_m_size i = 0; i < count; ++i)
+		names[i] = L"res_" + std::to_wstring(i);
+
+	DMResources res;
+	if (res.LoadResource(path, false))
+	{
+		runner.Measure(L"direct", reads, [&](_m_size i)
+		{
+			res.ReadResource(names[i % count], benchKey, DataRes).res.Release();
+		});
+	}
+	res.CloseResource();
+
+	auto mgr = runner.Context()->Base()->GetResourceMgr();
+	if (mgr->AddResourcePath(path, benchKey))
+	{
+		runner.Measure(L"manager", reads, [&](_m_size i)
+		{
+			mgr->ReadResource(names[i % count]).Release();
+		});
+		_m_size events = 0;
+		mgr->SetTraceCallback([&events](const UIResourceTraceEvent&) { events++; });
+		runner.Measure(L"manager.trace", reads, [&](_m_size i)
+		{
+			mgr->ReadResource(names[i % count]).Release();
+		});
+		mgr->SetTraceCallback(nullptr);
+		runner.Report(L"traceEvents", (double)events, L"");
+		mgr->RemoveResource(path);
+	}
+	DeleteFileW(path.c_str());
+}
+
+#if MUI_CFG_ENABLE_V2DMRES
+//修改1000个16KB资源中的一个后保存 比较追加保存和整理重写整个文件 输出每次保存耗时和文件尺寸
+MUI_BENCH(ResAppendSave)
+{
+	constexpr _m_size count = 1000;
+	constexpr _m_size size = 16 * 1024;
+	constexpr _m_size rounds = 10;
+	const std::wstring path = Bench::Runner::TempPath(L"append_src.dmres");
+	const std::wstring work = Bench::Runner::TempPath(L"append.dmres");
+	if (!MakePack(path, count, size, 0, false, true))
+		return;
+
+	std::vector<_m_byte> data(size);
+	for (int append = 0; append < 2; ++append)
+	{
+		if (!CopyFileW(path.c_str(), work.c_str(), FALSE))
+			continue;
+		const std::wstring mode = append ? L"append" : L"compact";
+		double total = 0;
+		for (_m_size i = 0; i < rounds; ++i)
+		{
+			DMResources res;
+			if (!res.LoadResource(work, false))
+				break;
+			FillData(data, count + i);
+			DMResKey key;
+			key.res = UIResource(data.data(), data.size());
+			if (!res.ChangeResource(L"res_" + std::to_wstring(i), key, benchKey))
+				break;
+			const auto begin = std::chrono::steady_clock::now();
+			if (!(append ? res.SaveResourceAppend() : res.Compact()))
+				break;
+			total += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		}
+		runner.Report(mode + L".save", total / rounds, L"ms");
+		WIN32_FILE_ATTRIBUTE_DATA attr = { 0 };
+		if (GetFileAttributesExW(work.c_str(), GetFileExInfoStandard, &attr))
+			runner.Report(mode + L".fileSize", (double)attr.nFileSizeLow / 1024.0, L"KB");
+		DeleteFileW(work.c_str());
+	}
+	DeleteFileW(path.c_str());
+}
+#endif
+
+//添加演示程序的资源文件 比较两种启动方式
+//lazy: Style只登记名称 之后首次查找时才创建 分别统计添加和创建全部Style的耗时
+//eager: 添加后立即创建全部Style 计为启动耗时
+//内存为启动完成时相对添加前的进程私有内存增量和峰值工作集增量
+//峰值工作集只增不减 eager在lazy之后运行 其峰值增量是超出之前峰值的部分
+MUI_BENCH(ResStyleLoad)
+{
+	constexpr _m_size rounds = 10;
+	const std::wstring path = Bench::Runner::DemoPackPath();
+	const auto names = Bench::Runner::ListStyles(path);
+	if (names.empty())
+		return;
+
+	auto memory = []
+	{
+		PROCESS_MEMORY_COUNTERS_EX info = { sizeof(info) };
+		GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&info, sizeof(info));
+		return info;
+	};
+
+	const auto render = runner.Context()->Base()->GetRender();
+	runner.Report(L"styles", (double)names.size(), L"");
+	for (int eager = 0; eager < 2; ++eager)
+	{
+		const std::wstring mode = eager ? L"eager" : L"lazy";
+		double startTime = 0, createTime = 0, privateUsage = 0, peakWorkingSet = 0;
+		_m_size created = 0;
+		for (_m_size i = 0; i < rounds; ++i)
+		{
+			UIResourceMgr mgr(render);
+			const auto before = memory();
+			const auto begin = std::chrono::steady_clock::now();
+			if (!mgr.AddResourcePath(path, Bench::Runner::DemoPackKey))
+				return;
+			created = 0;
+			if (eager)
+			{
+				for (auto& name : names)
+					created += mgr.FindStyle(name) != nullptr;
+			}
+			const auto started = std::chrono::steady_clock::now();
+			const auto after = memory();
+			if (!eager)
+			{
+				for (auto& name : names)
+					created += mgr.FindStyle(name) != nullptr;
+			}
+			const auto end = std::chrono::steady_clock::now();
+			startTime += std::chrono::duration<double, std::milli>(started - begin).count();
+			createTime += std::chrono::duration<double, std::milli>(end - started).count();
+			privateUsage += ((double)after.PrivateUsage - (double)before.PrivateUsage) / 1024.0;
+			peakWorkingSet += ((double)after.PeakWorkingSetSize - (double)before.PeakWorkingSetSize) / 1024.0;
+		}
+		runner.Report(mode + L".created", (double)created, L"");
+		runner.Report(mode + L".startup", startTime / rounds, L"ms");
+		if (!eager)
+			runner.Report(mode + L".createAll", createTime / rounds, L"ms");
+		runner.Report(mode + L".privateUsage", privateUsage / rounds, L"KB");
+		runner.Report(mode + L".peakWorkingSet", peakWorkingSet / rounds, L"KB");
+	}
+}
+
+//记录启动时使用的前32个Style 比较之后的启动使用与不使用预取清单时调用线程创建Style的耗时
+//添加资源文件后等待20ms 模拟窗口创建等其他启动工作
+MUI_BENCH(ResManifest)
+{
+	constexpr _m_size used = 32;
+	const std::wstring path = Bench::Runner::DemoPackPath();
+	auto names = Bench::Runner::ListStyles(path);
+	if (names.empty())
+		return;
+	if (names.size() > used)
+		names.resize(used);
+
+	const auto render = runner.Context()->Base()->GetRender();
+	const std::wstring manifest = Bench::Runner::TempPath(L"manifest.txt");
+	{
+		UIResourceMgr mgr(render);
+		if (!mgr.AddResourcePath(path, Bench::Runner::DemoPackKey))
+			return;
+		mgr.BeginRecordManifest(60000);
+		for (auto& name : names)
+			mgr.FindStyle(name);
+		if (!mgr.SaveManifest(manifest))
+			return;
+	}
+
+	for (int prefetch = 0; prefetch < 2; ++prefetch)
+	{
+		UIResourceMgr mgr(render);
+		if (prefetch && !mgr.LoadManifest(manifest))
+			continue;
+		if (!mgr.AddResourcePath(path, Bench::Runner::DemoPackKey))
+			continue;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		for (auto& name : names)
+			mgr.FindStyle(name);
+
+		const auto stats = mgr.GetLoadStats();
+		const std::wstring mode = prefetch ? L"manifest" : L"cold";
+		runner.Report(mode + L".syncTime", (double)stats.syncTime / 1000.0, L"ms");
+		runner.Report(mode + L".prefetchHits", (double)stats.prefetchHits, L"");
+	}
+	DeleteFileW(manifest.c_str());
+}
@@ -0,0 +1,84 @@
+﻿#include "Benchmark.h"
+#include <FileSystem/DreamMoonRes.h>
+#include <algorithm>
+
+using namespace Mui;
+
+namespace Bench
+{
+	namespace
+	{
+		struct BenchItem
+		{
+			std::wstring name;
+			BenchProc proc = nullptr;
+		};
+
+		std::vector<BenchItem>& BenchList()
+		{
+			static std::vector<BenchItem> list;
+			return list;
+		}
+	}
+
+	Register::Register(const wchar_t* name, BenchProc proc)
+	{
+		BenchList().push_back({ name, proc });
+	}
+
+	void Runner::Report(std::wstring_view name, double value, std::wstring_view unit)
+	{
+		wchar_t line[512];
+		swprintf_s(line, L"%ls.%.*ls: %.2f %.*ls\n", m_prefix.c_str(), (int)name.size(), name.data(),
+			value, (int)unit.size(), unit.data());
+		OutputDebugStringW(line);
+		if (m_out)
+		{
+			fputs(Helper::M_WStringToString(line).c_str(), m_out);
+			fflush(m_out);
+		}
+	}
+
+	std::wstring Runner::TempPath(std::wstring_view name)
+	{
+		return FS::MGetCurrentDir() + L"\\bench_" + std::wstring(name);
+	}
+
+	std::wstring Runner::DemoPackPath()
+	{
+		return FS::MGetCurrentDir() + L"\\resource.dmres";
+	}
+
+	std::vector<std::wstring> Runner::ListStyles(const std::wstring& path)
+	{
+		std::vector<std::wstring> list;
+		DMResources res;
+		if (!res.LoadResource(path, false) || !res.EnumResourceName(list))
+			return {};
+		list.erase(std::remove_if(list.begin(), list.end(), [](const std::wstring& name)
+		{
+			return name.compare(0, 6, L"style_") != 0;
+		}), list.end());
+		return list;
+	}
+
+	bool Run(MWindowCtx* ctx, std::wstring_view filter)
+	{
+		FILE* out = nullptr;
+		_wfopen_s(&out, (FS::MGetCurrentDir() + L"\\bench.txt").c_str(), L"wb");
+
+		Runner runner(ctx, out);
+		bool ran = false;
+		for (auto& item : BenchList())
+		{
+			if (item.name.compare(0, filter.size(), filter) != 0)
+				continue;
+			runner.m_prefix = item.name;
+			item.proc(runner);
+			ran = true;
+		}
+		if (out)
+			fclose(out);
+		return ran;
+	}
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+#include "MiaoUITest.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*性能测试
+* 使用启动参数 -bench 运行全部测试 -bench:名称 运行名称以该前缀开头的测试
+* 测试结果输出到程序目录的bench.txt 同时输出到调试器 运行完成后程序退出
+*/
+namespace Bench
+{
+	class Runner
+	{
+	public:
+		Runner(Mui::MWindowCtx* ctx, FILE* out) : m_ctx(ctx), m_out(out) {}
+
+		//窗口上下文 渲染相关的测试使用
+		[[nodiscard]] Mui::MWindowCtx* Context() const { return m_ctx; }
+
+		/*计时执行proc count次 并记录平均每次耗时
+		* @param name - 结果名称
+		*
+		* @return 平均每次耗时(纳秒)
+		*/
+		template<typename T>
+		double Measure(std::wstring_view name, Mui::_m_size count, T&& proc)
+		{
+			const auto begin = std::chrono::steady_clock::now();
+			for (Mui::_m_size i = 0; i < count; ++i)
+				proc(i);
+			const auto end = std::chrono::steady_clock::now();
+			const double ns = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() / (double)(count ? count : 1);
+			Report(name, ns, L"ns/op");
+			return ns;
+		}
+
+		//记录一个结果
+		void Report(std::wstring_view name, double value, std::wstring_view unit);
+
+		//获取临时文件路径 位于程序目录 测试结束后由测试项目删除
+		[[nodiscard]] static std::wstring TempPath(std::wstring_view name);
+
+		//演示程序的资源文件路径 位于程序目录 Style相关的测试使用
+		[[nodiscard]] static std::wstring DemoPackPath();
+
+		//演示程序资源文件的秘钥
+		static constexpr const wchar_t* DemoPackKey = L"12345678";
+
+		//列出资源文件中的全部Style名称 文件不存在时返回空列表
+		[[nodiscard]] static std::vector<std::wstring> ListStyles(const std::wstring& path);
+
+	private:
+		Mui::MWindowCtx* m_ctx = nullptr;
+		FILE* m_out = nullptr;
+		std::wstring m_prefix;
+
+		friend bool Run(Mui::MWindowCtx*, std::wstring_view);
+	};
+
+	using BenchProc = void(*)(Runner&);
+
+	//注册测试项目 请使用MUI_BENCH宏
+	struct Register
+	{
+		Register(const wchar_t* name, BenchProc proc);
+	};
+
+	/*运行测试项目
+	* @param ctx - 已显示的窗口上下文
+	* @param filter - 测试名称前缀 为空时运行全部测试
+	*
+	* @return 是否有测试项目被运行
+	*/
+	extern bool Run(Mui::MWindowCtx* ctx, std::wstring_view filter);
+}
+
+//定义并注册一个测试项目 函数体内可以使用runner
+#define MUI_BENCH(name) static void MuiBench_##name(Bench::Runner&); \
+	static Bench::Register MuiBenchReg_##name(L ## #name, MuiBench_##name); \
+	static void MuiBench_##name(Bench::Runner& runner)
@@ -1,5 +1,6 @@
 ﻿#include "MiaoUITest.h"
 #include "ControlTest.h"
+#include "Benchmark.h"
 #include <iomanip>
 
 using namespace Mui;
@@ -66,6 +67,20 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
 	base->ShowWindow(true);
 
+	//性能测试模式 -bench[:名称前缀] 运行完成后退出
+	std::wstring_view cmdLine = lpCmdLine;
+	if (auto pos = cmdLine.find(L"-bench"); pos != std::wstring_view::npos)
+	{
+		std::wstring_view filter;
+		if (cmdLine.size() > pos + 6 && cmdLine[pos + 6] == L':')
+		{
+			filter = cmdLine.substr(pos + 7);
+			filter = filter.substr(0, filter.find(L' '));
+		}
+		Bench::Run(windowCtx, filter);
+		return 0;
+	}
+
 	//base->SetMaxFPSLimit(60);
 
 	//窗口消息循环 直到窗口关闭